@@ -0,0 +1,220 @@
+/*
+ * Fixed-point field oriented control of PMSM motor
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * Current loop period: phase currents are transformed (Clarke, Park)
+ * to rotor oriented d/q frame, PI controllers compute d/q voltages
+ * which are transformed back (inverse Park, inverse Clarke) and
+ * modulated by space vector PWM implemented as min-max zero
+ * sequence injection. Speed and position loops run every
+ * speed_div current loop periods and provide q-axis current
+ * set-point.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "pmsm_foc.h"
+
+/* 1/3 in Q16, 1/sqrt(3) and sqrt(3)/2 in Q15 */
+#define PMSM_FOC_1_3_Q16      21845
+#define PMSM_FOC_1_SQRT3_Q15  18919
+#define PMSM_FOC_SQRT3_2_Q15  28378
+
+void pmsm_foc_init(pmsm_foc_t *foc, uint32_t irc_pos)
+{
+    /*
+     * Position is tracked within single electrical period when it is
+     * integer number of counts, direct per-count table can be used
+     * when the motor matches the build time configuration.
+     */
+    if (!(foc->irc_per_rev % foc->pole_pairs))
+        foc->rev_wrap = foc->irc_per_rev / foc->pole_pairs;
+    else
+        foc->rev_wrap = foc->irc_per_rev;
+  #if PMSM_TABLES_IRC_PERIOD
+    foc->irc_table_fl = (foc->irc_per_rev == PMSM_TABLES_IRC_PER_REV) &&
+                        (foc->pole_pairs == PMSM_TABLES_POLE_PAIRS);
+  #else
+    foc->irc_table_fl = 0;
+  #endif
+
+    foc->angle_inc = llround((double)foc->pole_pairs * 4294967296.0 / foc->irc_per_rev);
+    foc->irc_last = irc_pos;
+    foc->speed_pos_last = irc_pos;
+    foc->pos_ref = irc_pos;
+    foc->rev_pos = 0;
+    foc->angle = 0;
+    foc->aligned = 0;
+    foc->div_cnt = 0;
+    foc->steps = 0;
+    pmsm_foc_set_mode(foc, PMSM_FOC_OFF);
+}
+
+void pmsm_foc_set_mode(pmsm_foc_t *foc, int mode)
+{
+    foc->pi_d.sum = 0;
+    foc->pi_q.sum = 0;
+    foc->pi_speed.sum = 0;
+    foc->id_ref = 0;
+    foc->iq_ref = 0;
+    foc->speed_ref = 0;
+    foc->align_cnt = 0;
+    foc->pos_ref = foc->irc_last;
+    foc->mode = mode;
+}
+
+static inline int32_t pmsm_foc_wrap(const pmsm_foc_t *foc, int32_t pos)
+{
+    pos %= (int32_t)foc->rev_wrap;
+    if (pos < 0)
+        pos += foc->rev_wrap;
+    return pos;
+}
+
+void pmsm_foc_index_update(pmsm_foc_t *foc, uint32_t index_pos, uint32_t index_occur)
+{
+    int32_t from_index;
+
+    if (index_occur == foc->index_occur_last)
+        return;
+    foc->index_occur_last = index_occur;
+
+    /* Once per revolution, division is acceptable there */
+    from_index = (int32_t)(foc->irc_last - index_pos);
+
+    if (foc->index_offset_fl) {
+        foc->rev_pos = pmsm_foc_wrap(foc, from_index - foc->index_offset);
+        foc->aligned = 1;
+    } else if (foc->aligned) {
+        foc->index_offset = pmsm_foc_wrap(foc, from_index - foc->rev_pos);
+        foc->index_offset_fl = 1;
+    }
+}
+
+static inline void pmsm_foc_svpwm(pmsm_foc_t *foc, int32_t ualpha, int32_t ubeta)
+{
+    int32_t u[PMSM_FOC_PHASES];
+    int32_t umin, umax, uoffs;
+    int32_t half = foc->pwm_period / 2;
+    int32_t pwm;
+    int i;
+
+    /* Inverse Clarke */
+    u[0] = ualpha;
+    u[1] = (-ualpha * 16384 + ubeta * PMSM_FOC_SQRT3_2_Q15) >> PMSM_FOC_Q;
+    u[2] = (-ualpha * 16384 - ubeta * PMSM_FOC_SQRT3_2_Q15) >> PMSM_FOC_Q;
+
+    /* Zero sequence centering min and max gives SVPWM waveform */
+    umin = umax = u[0];
+    for (i = 1; i < PMSM_FOC_PHASES; i++) {
+        if (u[i] < umin)
+            umin = u[i];
+        if (u[i] > umax)
+            umax = u[i];
+    }
+    uoffs = half - ((umax + umin) >> 1);
+
+    for (i = 0; i < PMSM_FOC_PHASES; i++) {
+        pwm = u[i] + uoffs;
+        if (pwm < 0)
+            pwm = 0;
+        else if (pwm > foc->pwm_period)
+            pwm = foc->pwm_period;
+        foc->pwm[i] = pwm;
+    }
+}
+
+static inline void pmsm_foc_outer_loops(pmsm_foc_t *foc, uint32_t irc_pos)
+{
+    int32_t speed_ref;
+
+    if (++foc->div_cnt < foc->speed_div)
+        return;
+    foc->div_cnt = 0;
+
+    foc->speed = (int32_t)(irc_pos - foc->speed_pos_last) << PMSM_FOC_SPEED_FRACT;
+    foc->speed_pos_last = irc_pos;
+
+    if (foc->mode == PMSM_FOC_POSITION) {
+        speed_ref = ((int64_t)foc->pos_kp * (int32_t)(foc->pos_ref - irc_pos)) >>
+                    foc->pos_shift;
+        if (speed_ref > foc->speed_max)
+            speed_ref = foc->speed_max;
+        else if (speed_ref < -foc->speed_max)
+            speed_ref = -foc->speed_max;
+        foc->speed_ref = speed_ref;
+    }
+
+    foc->iq_ref = pmsm_foc_pi_step(&foc->pi_speed, foc->speed_ref - foc->speed);
+}
+
+void pmsm_foc_step(pmsm_foc_t *foc, uint32_t irc_pos, const int32_t cur[PMSM_FOC_PHASES])
+{
+    int32_t ialpha, ibeta;
+    int32_t ualpha, ubeta;
+    int32_t s, c;
+
+    foc->steps++;
+
+    /* Position within electrical period tracked incrementally */
+    foc->rev_pos += (int32_t)(irc_pos - foc->irc_last);
+    foc->irc_last = irc_pos;
+    while (foc->rev_pos >= (int32_t)foc->rev_wrap)
+        foc->rev_pos -= foc->rev_wrap;
+    while (foc->rev_pos < 0)
+        foc->rev_pos += foc->rev_wrap;
+    foc->angle = foc->rev_pos * foc->angle_inc;
+
+    if (foc->mode == PMSM_FOC_OFF) {
+        foc->pwm_en = 0;
+        return;
+    }
+    foc->pwm_en = 1;
+
+    if (foc->mode == PMSM_FOC_ALIGN) {
+        /* Rotor settles at zero electrical angle */
+        foc->ud = foc->align_ud;
+        foc->uq = 0;
+        pmsm_foc_svpwm(foc, foc->align_ud, 0);
+        if (++foc->align_cnt >= foc->align_steps) {
+            foc->rev_pos = 0;
+            foc->aligned = 1;
+            pmsm_foc_set_mode(foc, PMSM_FOC_CURRENT);
+        }
+        return;
+    }
+
+    if ((foc->mode == PMSM_FOC_SPEED) || (foc->mode == PMSM_FOC_POSITION))
+        pmsm_foc_outer_loops(foc, irc_pos);
+
+  #if PMSM_TABLES_IRC_PERIOD
+    if (foc->irc_table_fl) {
+        s = pmsm_foc_irc_sincos_table[foc->rev_pos][0];
+        c = pmsm_foc_irc_sincos_table[foc->rev_pos][1];
+    } else
+  #endif
+    {
+        s = pmsm_foc_sin(foc->angle);
+        c = pmsm_foc_cos(foc->angle);
+    }
+
+    /* Clarke */
+    ialpha = ((2 * cur[0] - cur[1] - cur[2]) * PMSM_FOC_1_3_Q16) >> 16;
+    ibeta = ((cur[1] - cur[2]) * PMSM_FOC_1_SQRT3_Q15) >> PMSM_FOC_Q;
+
+    /* Park */
+    foc->id = (ialpha * c + ibeta * s) >> PMSM_FOC_Q;
+    foc->iq = (ibeta * c - ialpha * s) >> PMSM_FOC_Q;
+
+    foc->ud = pmsm_foc_pi_step(&foc->pi_d, foc->id_ref - foc->id);
+    foc->uq = pmsm_foc_pi_step(&foc->pi_q, foc->iq_ref - foc->iq);
+
+    /* Inverse Park */
+    ualpha = (foc->ud * c - foc->uq * s) >> PMSM_FOC_Q;
+    ubeta = (foc->ud * s + foc->uq * c) >> PMSM_FOC_Q;
+
+    pmsm_foc_svpwm(foc, ualpha, ubeta);
+}
@@ -0,0 +1,161 @@
+#ifndef _PMSM_FOC_H
+#define _PMSM_FOC_H
+
+#include <stdint.h>
+
+#ifndef PMSM_TABLES_GEN
+#include "pmsm_tables.h"
+#endif
+
+#define PMSM_FOC_PHASES        3
+
+#define PMSM_FOC_SIN_BITS      10    /* table length 2^SIN_BITS per period */
+#define PMSM_FOC_SIN_SIZE      (1 << PMSM_FOC_SIN_BITS)
+#define PMSM_FOC_Q             15    /* sin/cos and transform constants */
+#define PMSM_FOC_SPEED_FRACT   8     /* speed fractional bits */
+
+enum pmsm_foc_mode {
+    PMSM_FOC_OFF = 0,    /* outputs disabled */
+    PMSM_FOC_ALIGN,      /* d-axis voltage at zero angle, then angle reset */
+    PMSM_FOC_CURRENT,    /* id_ref, iq_ref given */
+    PMSM_FOC_SPEED,      /* speed_ref given */
+    PMSM_FOC_POSITION,   /* pos_ref given */
+};
+
+/*
+ * Fixed-point PI controller, gains and integrator are scaled
+ * by 2^shift, the integrator is clamped to the output limit
+ * (anti-windup).
+ */
+typedef struct pmsm_foc_pi_t {
+    int32_t  kp;
+    int32_t  ki;
+    int      shift;
+    int32_t  out_max;
+    int32_t  sum;
+} pmsm_foc_pi_t;
+
+/*
+ * Field oriented control state. Currents are in ADC units
+ * (offset removed), voltages in PWM units, electrical angle
+ * is 32-bit with 2^32 per electrical revolution, speed is
+ * in IRC counts per speed loop period with PMSM_FOC_SPEED_FRACT
+ * fractional bits.
+ */
+typedef struct pmsm_foc_t {
+    /* Configuration */
+    uint32_t irc_per_rev;
+    uint32_t pole_pairs;
+    int32_t  pwm_period;
+    uint32_t speed_div;
+    pmsm_foc_pi_t pi_d;
+    pmsm_foc_pi_t pi_q;
+    pmsm_foc_pi_t pi_speed;
+    int32_t  pos_kp;
+    int      pos_shift;
+    int32_t  speed_max;
+    int32_t  align_ud;
+    uint32_t align_steps;
+
+    /* Set-points */
+    int      mode;
+    int32_t  id_ref;
+    int32_t  iq_ref;
+    int32_t  speed_ref;
+    uint32_t pos_ref;
+
+    /* Electrical angle mapping */
+    int32_t  index_offset;
+    int      index_offset_fl;
+    uint32_t index_occur_last;
+    uint32_t rev_wrap;
+    int      irc_table_fl;
+    int      aligned;
+
+    /* State */
+    uint32_t angle_inc;
+    uint32_t irc_last;
+    int32_t  rev_pos;
+    uint32_t angle;
+    int32_t  id;
+    int32_t  iq;
+    int32_t  ud;
+    int32_t  uq;
+    int32_t  speed;
+    uint32_t speed_pos_last;
+    uint32_t div_cnt;
+    uint32_t align_cnt;
+    uint32_t steps;
+
+    /* Outputs, 0 to pwm_period */
+    uint32_t pwm[PMSM_FOC_PHASES];
+    int      pwm_en;
+} pmsm_foc_t;
+
+void pmsm_foc_init(pmsm_foc_t *foc, uint32_t irc_pos);
+
+/*
+ * Align electrical angle to IRC index mark. The offset from index
+ * to electrical zero is learned at first index after alignment
+ * unless it has been preset (index_offset_fl), later index
+ * occurrences correct the angle for lost counts.
+ */
+void pmsm_foc_index_update(pmsm_foc_t *foc, uint32_t index_pos, uint32_t index_occur);
+
+void pmsm_foc_set_mode(pmsm_foc_t *foc, int mode);
+
+/* One current loop period, cur[] are phase currents */
+void pmsm_foc_step(pmsm_foc_t *foc, uint32_t irc_pos, const int32_t cur[PMSM_FOC_PHASES]);
+
+#ifndef PMSM_TABLES_GEN
+
+static inline int32_t pmsm_foc_sin_fast(uint32_t angle)
+{
+    return pmsm_foc_sin_table[angle >> (32 - PMSM_FOC_SIN_BITS)];
+}
+
+/* Linear interpolation between table entries, 15 bit fraction */
+static inline int32_t pmsm_foc_sin(uint32_t angle)
+{
+    uint32_t idx = angle >> (32 - PMSM_FOC_SIN_BITS);
+    int32_t frac = (angle >> (32 - PMSM_FOC_SIN_BITS - 15)) & 0x7fff;
+    int32_t a = pmsm_foc_sin_table[idx];
+    int32_t b = pmsm_foc_sin_table[idx + 1];
+
+    return a + (((b - a) * frac) >> 15);
+}
+
+static inline int32_t pmsm_foc_cos(uint32_t angle)
+{
+    return pmsm_foc_sin(angle + 0x40000000);
+}
+
+#endif /*PMSM_TABLES_GEN*/
+
+static inline int32_t pmsm_foc_pi_step(pmsm_foc_pi_t *pi, int32_t err)
+{
+    int32_t max = pi->out_max << pi->shift;
+    int64_t out;
+
+    /* Limit error to not overflow 32-bit arithmetic */
+    if (err > 0x7fff)
+        err = 0x7fff;
+    else if (err < -0x7fff)
+        err = -0x7fff;
+
+    pi->sum += pi->ki * err;
+    if (pi->sum > max)
+        pi->sum = max;
+    else if (pi->sum < -max)
+        pi->sum = -max;
+
+    out = (int64_t)pi->kp * err + pi->sum;
+    if (out > max)
+        out = max;
+    else if (out < -max)
+        out = -max;
+
+    return out >> pi->shift;
+}
+
+#endif /*_PMSM_FOC_H*/
@@ -0,0 +1,98 @@
+/*
+ * Build time generator of PMSM commutation tables
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * Runs on the build host, writes header (h) or tables source (c)
+ * to stdout for given motor pole pairs and IRC counts per revolution.
+ * The per-count sin/cos table is generated only when electrical
+ * period is integer number of IRC counts not exceeding
+ * PMSM_TABLES_IRC_MAX.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Tables are not generated yet */
+#define PMSM_TABLES_GEN
+#include "pmsm_foc.h"
+
+#define PMSM_TABLES_IRC_MAX  8192
+
+static long q15(double x)
+{
+    return lrint(x * 32767);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long pole_pairs;
+    unsigned long irc_per_rev;
+    unsigned long e_period = 0;
+    unsigned long i;
+    char *p;
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s h|c <pole_pairs> <irc_per_rev>\n", argv[0]);
+        return 1;
+    }
+
+    pole_pairs = strtoul(argv[2], &p, 0);
+    if ((argv[2] == p) || !pole_pairs) {
+        fprintf(stderr, "%s: pole pairs parse error\n", argv[0]);
+        return 1;
+    }
+    irc_per_rev = strtoul(argv[3], &p, 0);
+    if ((argv[3] == p) || !irc_per_rev) {
+        fprintf(stderr, "%s: IRC per revolution parse error\n", argv[0]);
+        return 1;
+    }
+
+    if (!(irc_per_rev % pole_pairs) && (irc_per_rev / pole_pairs <= PMSM_TABLES_IRC_MAX))
+        e_period = irc_per_rev / pole_pairs;
+
+    printf("/* Generated by pmsm_tables_gen, do not edit */\n\n");
+
+    if (!strcmp(argv[1], "h")) {
+        printf("#ifndef _PMSM_TABLES_H\n#define _PMSM_TABLES_H\n\n");
+        printf("#include <stdint.h>\n\n");
+        printf("#define PMSM_TABLES_POLE_PAIRS   %lu\n", pole_pairs);
+        printf("#define PMSM_TABLES_IRC_PER_REV  %lu\n", irc_per_rev);
+        printf("#define PMSM_TABLES_IRC_PERIOD   %lu  /* IRC counts per electrical period */\n\n",
+               e_period);
+        printf("/* Q15 sine, one extra entry for interpolation */\n");
+        printf("extern const int16_t pmsm_foc_sin_table[%d];\n", PMSM_FOC_SIN_SIZE + 1);
+        if (e_period) {
+            printf("\n/* Q15 sine and cosine for each IRC count within electrical period */\n");
+            printf("extern const int16_t pmsm_foc_irc_sincos_table[%lu][2];\n", e_period);
+        }
+        printf("\n#endif /*_PMSM_TABLES_H*/\n");
+        return 0;
+    }
+
+    if (strcmp(argv[1], "c")) {
+        fprintf(stderr, "%s: unknown output kind %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    printf("#include \"pmsm_tables.h\"\n\n");
+
+    printf("const int16_t pmsm_foc_sin_table[%d] = {", PMSM_FOC_SIN_SIZE + 1);
+    for (i = 0; i <= PMSM_FOC_SIN_SIZE; i++)
+        printf("%s%6ld,", i % 8? " ": "\n   ",
+               q15(sin(2 * M_PI * i / PMSM_FOC_SIN_SIZE)));
+    printf("\n};\n");
+
+    if (e_period) {
+        printf("\nconst int16_t pmsm_foc_irc_sincos_table[%lu][2] = {", e_period);
+        for (i = 0; i < e_period; i++)
+            printf("%s{%6ld, %6ld},", i % 4? " ": "\n   ",
+                   q15(sin(2 * M_PI * i / e_period)),
+                   q15(cos(2 * M_PI * i / e_period)));
+        printf("\n};\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,1189 @@
+/*
+ * Native field oriented control of PMSM motor on RPi SPI
+ * and Zynq 3-phase motor driver boards
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * The application runs current, speed and position loops
+ * of 3-phase PMSM motor in single realtime task without
+ * Simulink model step overhead. Hardware access uses
+ * the same code as rpi_pmsm_motor_control and
+ * zynq_pmsm_motor_control Simulink models.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>  /* this provides mlockall() */
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "pmsm_foc.h"
+#include "rpi_spimc.h"
+#include "zynq_3pmdrv1_mc.h"
+#include "spimc_frame_check.h"
+#include "zynq_uio_mock.h"
+#include "rpi_spimc_module.h"
+
+#define FOC_ADC_CALIB_STEPS  1000
+#define FOC_SPI_TRAIN_TRIALS 200
+/* Longest wait for Zynq PWM period interrupt */
+#define FOC_PERIOD_WAIT_USEC 10000
+/* ADC samples per PWM period of mock UIO device */
+#define FOC_MOCK_ADC_PER_PERIOD 8
+/* Device of kernel/modules/rpi_spimc_module.c */
+#define FOC_KMOD_DEV         "/dev/spimc0"
+/* Zynq IP cores (axes) of benchaxes */
+#define FOC_BENCH_AXES       4
+/*
+ * Board states opened by benchbatch, all on the same SPI device
+ * node (chip select), so it measures the per-message overhead
+ * only, not transfers to separate boards
+ */
+#define FOC_BENCH_BOARDS     4
+
+int foc_zynq_fl;
+spimc_state_t spimcst = {
+    .spi_dev = "/dev/spidev0.1",
+};
+z3pmdrv1_state_t z3pmcst;
+pmsm_foc_t foc;
+int base_task_prio;
+uint32_t sample_period_nsec = 50 * 1000;
+struct timespec sample_period_time;
+struct timespec monitor_period_time;
+uint32_t irc_per_rev = 4000;
+uint32_t pole_pairs = 4;
+
+int32_t index_offset;
+int index_offset_fl;
+
+/* Train SPI link up to this clock at start, zero keeps set speed */
+uint32_t spi_train_max;
+
+/*
+ * Pipelined mode overlaps SPI transfer with computation. The step
+ * uses measurements of the previous frame, which adds one period
+ * of latency, and cycle time is limited by the longer of transfer
+ * and computation instead of their sum.
+ */
+int foc_pipeline_fl;
+int foc_hw_submit_ret;
+
+typedef struct foc_meas_t {
+    uint32_t irc_pos;
+    uint32_t index_pos;
+    uint32_t index_occur;
+    int32_t  cur[PMSM_FOC_PHASES];
+} foc_meas_t;
+
+/* Set-point change requested by the main thread */
+typedef struct foc_request_t {
+    int      mode;
+    int32_t  value;
+    uint32_t seq;
+} foc_request_t;
+
+foc_request_t foc_request;
+uint32_t foc_request_applied;
+
+/* Step timing statistics */
+int64_t step_nsec_max;
+int64_t step_nsec_sum;
+uint32_t step_count;
+uint32_t overruns;
+volatile int foc_stats_reset_req;
+
+volatile int foc_hw_ready;
+volatile int foc_task_stop;
+pthread_t foc_thread;
+int foc_thread_fl;
+
+static inline int64_t timespec_diff_nsec(const struct timespec *a,
+                                         const struct timespec *b)
+{
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 +
+           (a->tv_nsec - b->tv_nsec);
+}
+
+static inline void timespec_add_nsec(struct timespec *t, int64_t nsec)
+{
+    nsec += t->tv_nsec;
+    while (nsec >= 1000000000) {
+        nsec -= 1000000000;
+        t->tv_sec++;
+    }
+    t->tv_nsec = nsec;
+}
+
+static void foc_hw_set_pwm(void)
+{
+    int i;
+
+    if (!foc_zynq_fl) {
+        for (i = 0; i < SPIMC_CHAN_COUNT; i++)
+            spimcst.pwm[i] = foc.pwm_en? foc.pwm[i] | SPIMC_PWM_ENABLE:
+                                         SPIMC_PWM_SHUTDOWN;
+    } else {
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+            z3pmcst.pwm[i] = foc.pwm_en? foc.pwm[i] | Z3PMDRV1_PWM_ENABLE:
+                                         Z3PMDRV1_PWM_SHUTDOWN;
+    }
+}
+
+/*
+ * Position and currents of the completed transfer. Currents
+ * are left unchanged when the ADC sequence number indicates
+ * invalid sample.
+ */
+static void foc_hw_collect(foc_meas_t *meas)
+{
+    int i;
+
+    if (!foc_zynq_fl) {
+        if (spimc_curadc_currents(&spimcst) >= 0)
+            for (i = 0; i < SPIMC_CHAN_COUNT; i++)
+                meas->cur[i] = spimcst.curadc_val[i] >> SPIMC_CURADC_FRACT;
+        spimcst.curadc_sqn_last = spimcst.curadc_sqn;
+        for (i = 0; i < SPIMC_CHAN_COUNT; i++)
+            spimcst.curadc_cumsum_last[i] = spimcst.curadc_cumsum[i];
+        meas->irc_pos = spimcst.act_pos;
+        meas->index_pos = spimcst.index_pos;
+        meas->index_occur = spimcst.index_occur;
+    } else {
+        if (z3pmdrv1_curadc_currents(&z3pmcst) >= 0)
+            for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+                meas->cur[i] = z3pmcst.curadc_val[i] >> Z3PMDRV1_CURADC_FRACT;
+        z3pmcst.curadc_sqn_last = z3pmcst.curadc_sqn;
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+            z3pmcst.curadc_cumsum_last[i] = z3pmcst.curadc_cumsum[i];
+        meas->irc_pos = z3pmcst.act_pos;
+        meas->index_pos = z3pmcst.index_pos;
+        meas->index_occur = z3pmcst.index_occur;
+    }
+}
+
+/* Send PWM computed in the previous period and read position and currents */
+int foc_hw_transfer(foc_meas_t *meas)
+{
+    foc_hw_set_pwm();
+
+    if (!foc_zynq_fl) {
+        if (spimc_transfer(&spimcst) < 0)
+            return -1;
+    } else {
+        if (z3pmdrv1_transfer(&z3pmcst) < 0)
+            return -1;
+    }
+
+    foc_hw_collect(meas);
+
+    return 0;
+}
+
+/*
+ * Pipelined variant, the SPI frame is exchanged by I/O thread
+ * between foc_hw_submit() and foc_hw_complete(). Zynq registers
+ * are accessed directly in foc_hw_submit().
+ */
+int foc_hw_submit(void)
+{
+    foc_hw_set_pwm();
+
+    if (!foc_zynq_fl)
+        return spimc_submit(&spimcst);
+
+    foc_hw_submit_ret = z3pmdrv1_transfer(&z3pmcst);
+    return 0;
+}
+
+int foc_hw_complete(foc_meas_t *meas)
+{
+    if (!foc_zynq_fl) {
+        if (spimc_complete(&spimcst) < 0)
+            return -1;
+    } else {
+        if (foc_hw_submit_ret < 0)
+            return -1;
+    }
+
+    foc_hw_collect(meas);
+
+    return 0;
+}
+
+int foc_hw_init(void)
+{
+    if (!foc_zynq_fl) {
+        if (spimc_init(&spimcst) < 0)
+            return -1;
+        if (spi_train_max &&
+            (spimc_train_link(&spimcst, spi_train_max, FOC_SPI_TRAIN_TRIALS) < 0))
+            return -1;
+        if (foc_pipeline_fl &&
+            (spimc_async_start(&spimcst, base_task_prio + 1) < 0))
+            return -1;
+    } else {
+        if (z3pmdrv1_init(&z3pmcst) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Zero current offsets measured with outputs switched off */
+int foc_adc_calibrate(void)
+{
+    foc.pwm_en = 0;
+
+    if (!foc_zynq_fl)
+        return spimc_curadc_calibrate(&spimcst, FOC_ADC_CALIB_STEPS,
+                                      sample_period_nsec / 1000);
+    else
+        return z3pmdrv1_curadc_calibrate(&z3pmcst, FOC_ADC_CALIB_STEPS,
+                                         sample_period_nsec / 1000);
+}
+
+/* Starting values, have to be tuned for given motor and power stage */
+void foc_config_defaults(pmsm_foc_t *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->irc_per_rev = irc_per_rev;
+    f->pole_pairs = pole_pairs;
+    f->pwm_period = foc_zynq_fl? 5000: 2048;
+    f->speed_div = 20;
+
+    f->pi_d.kp = 64;
+    f->pi_d.ki = 4;
+    f->pi_d.shift = 8;
+    f->pi_d.out_max = f->pwm_period * 9 / 16;
+    f->pi_q = f->pi_d;
+
+    f->pi_speed.kp = 200;
+    f->pi_speed.ki = 4;
+    f->pi_speed.shift = 8;
+    f->pi_speed.out_max = 500;
+
+    f->pos_kp = 64;
+    f->pos_shift = 4;
+    f->speed_max = 50 << PMSM_FOC_SPEED_FRACT;
+
+    f->index_offset = index_offset;
+    f->index_offset_fl = index_offset_fl;
+
+    f->align_ud = f->pwm_period / 10;
+    f->align_steps = 1000 * 1000 * 1000 / sample_period_nsec;
+}
+
+void foc_request_set(int mode, int32_t value)
+{
+    foc_request.mode = mode;
+    foc_request.value = value;
+    __atomic_add_fetch(&foc_request.seq, 1, __ATOMIC_RELEASE);
+}
+
+static inline void foc_request_apply(void)
+{
+    uint32_t seq = __atomic_load_n(&foc_request.seq, __ATOMIC_ACQUIRE);
+
+    if (seq == foc_request_applied)
+        return;
+    foc_request_applied = seq;
+
+    if (foc.mode != foc_request.mode)
+        pmsm_foc_set_mode(&foc, foc_request.mode);
+
+    switch (foc_request.mode) {
+        case PMSM_FOC_CURRENT:
+            foc.iq_ref = foc_request.value;
+            break;
+        case PMSM_FOC_SPEED:
+            foc.speed_ref = foc_request.value;
+            break;
+        case PMSM_FOC_POSITION:
+            foc.pos_ref = foc.irc_last + foc_request.value;
+            break;
+    }
+}
+
+void *foc_task(void *arg)
+{
+    foc_meas_t meas;
+    struct timespec now;
+    int64_t step_nsec;
+
+    memset(&meas, 0, sizeof(meas));
+    foc_hw_transfer(&meas);
+    pmsm_foc_init(&foc, meas.irc_pos);
+    foc.index_occur_last = meas.index_occur;
+
+    do {
+        /* Step is started by PWM period interrupt when UIO is used */
+        if (foc_zynq_fl && (z3pmcst.irq_fd >= 0)) {
+            if (z3pmdrv1_wait_period(&z3pmcst, FOC_PERIOD_WAIT_USEC) < 0) {
+                overruns++;
+                continue;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &sample_period_time);
+        } else {
+            timespec_add_nsec(&sample_period_time, sample_period_nsec);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sample_period_time, NULL);
+        }
+
+        if (!foc_pipeline_fl) {
+            if (foc_hw_transfer(&meas) < 0)
+                continue;
+            foc_request_apply();
+            pmsm_foc_index_update(&foc, meas.index_pos, meas.index_occur);
+            pmsm_foc_step(&foc, meas.irc_pos, meas.cur);
+        } else {
+            foc_hw_submit();
+            foc_request_apply();
+            pmsm_foc_index_update(&foc, meas.index_pos, meas.index_occur);
+            pmsm_foc_step(&foc, meas.irc_pos, meas.cur);
+            foc_hw_complete(&meas);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        step_nsec = timespec_diff_nsec(&now, &sample_period_time);
+        if (foc_stats_reset_req) {
+            step_nsec_max = 0;
+            step_nsec_sum = 0;
+            step_count = 0;
+            foc_stats_reset_req = 0;
+        }
+        if (step_nsec > step_nsec_max)
+            step_nsec_max = step_nsec;
+        step_nsec_sum += step_nsec;
+        step_count++;
+        if (step_nsec > sample_period_nsec)
+            overruns++;
+    } while(!foc_task_stop);
+
+    return NULL;
+}
+
+int create_rt_task(pthread_t *thread, int prio, void *(*start_routine) (void *), void *arg)
+{
+    int ret ;
+
+    pthread_attr_t attr;
+    struct sched_param schparam;
+
+    if (pthread_attr_init(&attr) != 0) {
+        fprintf(stderr, "pthread_attr_init failed\n");
+        return -1;
+    }
+
+    if (pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED) != 0) {
+        fprintf(stderr, "pthread_attr_setinheritsched failed\n");
+        return -1;
+    }
+
+    if (pthread_attr_setschedpolicy(&attr, SCHED_FIFO) != 0) {
+        fprintf(stderr, "pthread_attr_setschedpolicy SCHED_FIFO failed\n");
+        return -1;
+    }
+
+    schparam.sched_priority = prio;
+
+    if (pthread_attr_setschedparam(&attr, &schparam) != 0) {
+        fprintf(stderr, "pthread_attr_setschedparam failed\n");
+        return -1;
+    }
+
+    ret = pthread_create(thread, &attr, start_routine, arg);
+
+    pthread_attr_destroy(&attr);
+
+    return ret;
+}
+
+void stop_motor(void)
+{
+    foc_meas_t meas;
+
+    if (!foc_hw_ready)
+        return;
+
+    /* Hardware and its I/O thread are released by the realtime task */
+    if (foc_thread_fl) {
+        foc_task_stop = 1;
+        pthread_join(foc_thread, NULL);
+    }
+
+    foc.mode = PMSM_FOC_OFF;
+    foc.pwm_en = 0;
+    if (!foc_zynq_fl && spimcst.xfer_pending)
+        spimc_complete(&spimcst);
+    foc_hw_transfer(&meas);
+}
+
+void sig_handler(int sig)
+{
+    exit(1);
+}
+
+void setup_environment(const char *argv0)
+{
+    struct sigaction sigact;
+    int fifo_min_prio = sched_get_priority_min(SCHED_FIFO);
+    int fifo_max_prio = sched_get_priority_max(SCHED_FIFO);
+
+    base_task_prio = fifo_max_prio - 20;
+    if (base_task_prio < fifo_min_prio)
+        base_task_prio = fifo_min_prio;
+
+    if (foc_hw_init() < 0) {
+        fprintf(stderr, "%s: cannot initialize %s motor driver\n", argv0,
+                foc_zynq_fl? "Zynq 3pmdrv1": "SPI");
+        exit(1);
+    }
+    foc_hw_ready = 1;
+
+    if (mlockall(MCL_FUTURE | MCL_CURRENT) < 0) {
+        fprintf(stderr, "%s: mlockall failed - cannot lock application in memory\n", argv0);
+        exit(1);
+    }
+
+    atexit(stop_motor);
+
+    memset(&sigact, 0, sizeof(sigact));
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+}
+
+/* Align rotor to zero electrical angle and then apply requested mode */
+void run_foc(int mode, int32_t value)
+{
+    uint32_t cnt;
+
+    foc_config_defaults(&foc);
+    if (foc_adc_calibrate() < 0) {
+        fprintf(stderr, "current offsets calibration failed\n");
+        exit(1);
+    }
+    printf("current offsets %ld %ld %ld\n",
+           (long)(foc_zynq_fl? z3pmcst.curadc_offs[0]: spimcst.curadc_offs[0]),
+           (long)(foc_zynq_fl? z3pmcst.curadc_offs[1]: spimcst.curadc_offs[1]),
+           (long)(foc_zynq_fl? z3pmcst.curadc_offs[2]: spimcst.curadc_offs[2]));
+
+    clock_gettime(CLOCK_MONOTONIC, &sample_period_time);
+    monitor_period_time = sample_period_time;
+
+    if (create_rt_task(&foc_thread, base_task_prio, foc_task, NULL) != 0) {
+        fprintf(stderr, "cannot start realtime foc task\n");
+        exit(1);
+    }
+    foc_thread_fl = 1;
+
+    foc_request_set(PMSM_FOC_ALIGN, 0);
+    for (cnt = 0; ; cnt++) {
+        monitor_period_time.tv_sec += 1;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &monitor_period_time, NULL);
+        /* Alignment finishes in current mode with zero set-point */
+        if (cnt == 1)
+            foc_request_set(mode, value);
+        printf("mode %d%s pos %ld speed %ld id %ld iq %ld ud %ld uq %ld"
+               " step avg %ld max %ld ns overruns %lu\n",
+               foc.mode, foc.index_offset_fl? " index": "", (long)(int32_t)foc.irc_last,
+               (long)(foc.speed >> PMSM_FOC_SPEED_FRACT), (long)foc.id, (long)foc.iq,
+               (long)foc.ud, (long)foc.uq,
+               (long)(step_count? step_nsec_sum / step_count: 0),
+               (long)step_nsec_max, (unsigned long)overruns);
+        if (!foc_zynq_fl && spimcst.frame_errors)
+            printf("frames rejected %lu retried %lu failed %lu\n",
+                   (unsigned long)spimcst.frame_errors,
+                   (unsigned long)spimcst.frame_retries,
+                   (unsigned long)spimcst.frame_failures);
+        foc_stats_reset_req = 1;
+    }
+}
+
+/*
+ * Cost of the complete current loop step including outer
+ * loops with synthetic rotating currents, no hardware needed.
+ */
+void run_bench(unsigned long steps)
+{
+    pmsm_foc_t f;
+    int32_t cur[PMSM_FOC_PHASES];
+    uint32_t irc_pos = 0;
+    uint32_t angle;
+    struct timespec t0, t1, ts;
+    int64_t nsec;
+    int64_t nsec_max = 0;
+    unsigned long i;
+
+    foc_config_defaults(&f);
+    pmsm_foc_init(&f, irc_pos);
+    pmsm_foc_set_mode(&f, PMSM_FOC_SPEED);
+    f.speed_ref = 3 << PMSM_FOC_SPEED_FRACT;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < steps; i++) {
+        irc_pos += (i & 7) == 0;
+        angle = f.angle + 0x10000000;
+        cur[0] = pmsm_foc_sin(angle) >> 6;
+        cur[1] = pmsm_foc_sin(angle - 0x55555555) >> 6;
+        cur[2] = -cur[0] - cur[1];
+        pmsm_foc_step(&f, irc_pos, cur);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nsec = timespec_diff_nsec(&t1, &t0);
+
+    /* Second pass for the worst case, includes clock read cost */
+    for (i = 0; i < steps; i++) {
+        irc_pos += (i & 7) == 0;
+        cur[0] = pmsm_foc_sin(f.angle) >> 6;
+        cur[1] = pmsm_foc_sin(f.angle - 0x55555555) >> 6;
+        cur[2] = -cur[0] - cur[1];
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        pmsm_foc_step(&f, irc_pos, cur);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (timespec_diff_nsec(&t1, &ts) > nsec_max)
+            nsec_max = timespec_diff_nsec(&t1, &ts);
+    }
+
+    printf("steps %lu, avg %.1f ns, max %lld ns per step\n", steps,
+           (double)nsec / steps, (long long)nsec_max);
+    printf("%.2f %% of %lu ns period, pwm %lu %lu %lu\n",
+           100.0 * nsec / steps / sample_period_nsec,
+           (unsigned long)sample_period_nsec, (unsigned long)f.pwm[0],
+           (unsigned long)f.pwm[1], (unsigned long)f.pwm[2]);
+}
+
+volatile int32_t bench_sink;
+
+/* Actual CPU clock from cpufreq, 0 when unknown */
+static double bench_cpu_hz(void)
+{
+    FILE *f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq", "r");
+    unsigned long khz = 0;
+
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%lu", &khz) != 1)
+        khz = 0;
+    fclose(f);
+
+    return khz * 1000.0;
+}
+
+static void bench_sin_report(const char *name, double err_max, int64_t nsec,
+                             unsigned long calls, double cpu_hz)
+{
+    printf("%-18s max err %7.3f LSB  %6.2f ns", name, err_max, (double)nsec / calls);
+    if (cpu_hz)
+        printf("  %6.1f cycles", nsec * 1e-9 * cpu_hz / calls);
+    printf(" per sin+cos\n");
+}
+
+/*
+ * Accuracy (Q15 LSB against double precision) and cost of table
+ * sine/cosine variants compared to sinf()/cosf().
+ */
+void run_bench_sin(unsigned long calls)
+{
+    struct timespec t0, t1;
+    double cpu_hz = bench_cpu_hz();
+    double err, err_max;
+    double x;
+    uint32_t angle;
+    uint32_t pos;
+    unsigned long i;
+    int32_t sum;
+    float fsum;
+
+    printf("tables for %lu pole pairs, %lu IRC counts per revolution\n",
+           (unsigned long)PMSM_TABLES_POLE_PAIRS, (unsigned long)PMSM_TABLES_IRC_PER_REV);
+
+    err_max = 0;
+    for (angle = 0, i = 0; i < (1 << 20); i++, angle += 1 << 12) {
+        err = fabs(pmsm_foc_sin_fast(angle) - sin(angle * (2 * M_PI / 4294967296.0)) * 32767);
+        if (err > err_max)
+            err_max = err;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (sum = 0, angle = 0, i = 0; i < calls; i++, angle += 0x01234567)
+        sum += pmsm_foc_sin_fast(angle) + pmsm_foc_sin_fast(angle + 0x40000000);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    bench_sink = sum;
+    bench_sin_report("table", err_max, timespec_diff_nsec(&t1, &t0), calls, cpu_hz);
+
+    err_max = 0;
+    for (angle = 0, i = 0; i < (1 << 20); i++, angle += 1 << 12) {
+        err = fabs(pmsm_foc_sin(angle) - sin(angle * (2 * M_PI / 4294967296.0)) * 32767);
+        if (err > err_max)
+            err_max = err;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (sum = 0, angle = 0, i = 0; i < calls; i++, angle += 0x01234567)
+        sum += pmsm_foc_sin(angle) + pmsm_foc_cos(angle);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    bench_sink = sum;
+    bench_sin_report("table interpolated", err_max, timespec_diff_nsec(&t1, &t0), calls, cpu_hz);
+
+  #if PMSM_TABLES_IRC_PERIOD
+    err_max = 0;
+    for (pos = 0; pos < PMSM_TABLES_IRC_PERIOD; pos++) {
+        x = 2 * M_PI * pos / PMSM_TABLES_IRC_PERIOD;
+        err = fabs(pmsm_foc_irc_sincos_table[pos][0] - sin(x) * 32767);
+        if (err > err_max)
+            err_max = err;
+        err = fabs(pmsm_foc_irc_sincos_table[pos][1] - cos(x) * 32767);
+        if (err > err_max)
+            err_max = err;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (sum = 0, pos = 0, i = 0; i < calls; i++) {
+        pos += 7;
+        if (pos >= PMSM_TABLES_IRC_PERIOD)
+            pos -= PMSM_TABLES_IRC_PERIOD;
+        sum += pmsm_foc_irc_sincos_table[pos][0] + pmsm_foc_irc_sincos_table[pos][1];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    bench_sink = sum;
+    bench_sin_report("IRC count table", err_max, timespec_diff_nsec(&t1, &t0), calls, cpu_hz);
+  #endif
+
+    err_max = 0;
+    for (angle = 0, i = 0; i < (1 << 20); i++, angle += 1 << 12) {
+        x = angle * (2 * M_PI / 4294967296.0);
+        err = fabs(sinf(x) * 32767 - sin(x) * 32767);
+        if (err > err_max)
+            err_max = err;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (fsum = 0, angle = 0, i = 0; i < calls; i++, angle += 0x01234567) {
+        float xf = angle * (float)(2 * M_PI / 4294967296.0);
+        fsum += sinf(xf) + cosf(xf);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    bench_sink = fsum;
+    bench_sin_report("sinf/cosf", err_max, timespec_diff_nsec(&t1, &t0), calls, cpu_hz);
+}
+
+/* Report transfer time at the set clock and after link training */
+void run_spi_train(void)
+{
+    if (foc_zynq_fl) {
+        fprintf(stderr, "spitrain: Zynq driver has no SPI link\n");
+        exit(1);
+    }
+    if (spimc_init(&spimcst) < 0)
+        exit(1);
+    if (spimc_measure_transfer(&spimcst, FOC_SPI_TRAIN_TRIALS) < 0) {
+        fprintf(stderr, "spitrain: transfer failed\n");
+        exit(1);
+    }
+    printf("initial speed: %lu Hz, transfer %lu ns\n",
+           (unsigned long)spimcst.spi_speed, (unsigned long)spimcst.transfer_nsec);
+    if (spimc_train_link(&spimcst, spi_train_max? spi_train_max:
+                         SPIMC_TRAIN_SPEED_MAX, FOC_SPI_TRAIN_TRIALS) < 0) {
+        fprintf(stderr, "spitrain: link training failed\n");
+        exit(1);
+    }
+}
+
+/*
+ * Back to back cycles of transfer and step, sequential and pipelined.
+ * Motor is kept in current mode with zero set-point.
+ */
+void run_bench_pipe(unsigned long steps)
+{
+    foc_meas_t meas;
+    struct timespec t0, t1;
+    int64_t nsec_seq, nsec_pipe, nsec_step, nsec_xfer, nsec_par;
+    unsigned long i;
+
+    foc_pipeline_fl = 1;
+    setup_environment("benchpipe");
+
+    foc_config_defaults(&foc);
+    if (foc_adc_calibrate() < 0) {
+        fprintf(stderr, "benchpipe: current offsets calibration failed\n");
+        exit(1);
+    }
+    memset(&meas, 0, sizeof(meas));
+    foc_hw_transfer(&meas);
+    pmsm_foc_init(&foc, meas.irc_pos);
+    pmsm_foc_set_mode(&foc, PMSM_FOC_CURRENT);
+    foc.iq_ref = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < steps; i++) {
+        if (foc_hw_transfer(&meas) < 0) {
+            fprintf(stderr, "benchpipe: transfer failed\n");
+            exit(1);
+        }
+        pmsm_foc_step(&foc, meas.irc_pos, meas.cur);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nsec_seq = timespec_diff_nsec(&t1, &t0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < steps; i++) {
+        foc_hw_submit();
+        pmsm_foc_step(&foc, meas.irc_pos, meas.cur);
+        if (foc_hw_complete(&meas) < 0) {
+            fprintf(stderr, "benchpipe: transfer failed\n");
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nsec_pipe = timespec_diff_nsec(&t1, &t0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < steps; i++)
+        pmsm_foc_step(&foc, meas.irc_pos, meas.cur);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nsec_step = timespec_diff_nsec(&t1, &t0);
+
+    /*
+     * Ideal pipelined cycle is the longer of transfer and step,
+     * the rest is the cost of the hand-over to the I/O thread
+     */
+    nsec_xfer = nsec_seq - nsec_step;
+    nsec_par = nsec_xfer > nsec_step? nsec_xfer: nsec_step;
+
+    printf("steps %lu, sequential avg %.1f ns, pipelined avg %.1f ns per cycle\n",
+           steps, (double)nsec_seq / steps, (double)nsec_pipe / steps);
+    printf("FOC step avg %.1f ns, transfer avg %.1f ns, hand-over avg %.1f ns\n",
+           (double)nsec_step / steps, (double)nsec_xfer / steps,
+           (double)(nsec_pipe - nsec_par) / steps);
+    printf("pipelining pays off when the step is longer than the hand-over,\n"
+           "pipelined step uses measurements delayed by one period\n");
+}
+
+/* Separate transfers for each board against one batched message */
+void run_bench_batch(unsigned long cycles)
+{
+    spimc_state_t boards[FOC_BENCH_BOARDS];
+    spimc_state_t *bp[FOC_BENCH_BOARDS];
+    struct timespec t0, t1;
+    int64_t nsec_seq, nsec_batch;
+    unsigned long i;
+    int b;
+
+    if (foc_zynq_fl) {
+        fprintf(stderr, "benchbatch: Zynq driver has no SPI link\n");
+        exit(1);
+    }
+    memset(boards, 0, sizeof(boards));
+    for (b = 0; b < FOC_BENCH_BOARDS; b++) {
+        boards[b].spi_dev = spimcst.spi_dev;
+        boards[b].spi_speed = spimcst.spi_speed;
+        if (spimc_init(&boards[b]) < 0)
+            exit(1);
+        bp[b] = &boards[b];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < cycles; i++) {
+        for (b = 0; b < FOC_BENCH_BOARDS; b++) {
+            if (spimc_transfer(bp[b]) < 0) {
+                fprintf(stderr, "benchbatch: transfer failed\n");
+                exit(1);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nsec_seq = timespec_diff_nsec(&t1, &t0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < cycles; i++) {
+        if (spimc_transfer_batch(bp, FOC_BENCH_BOARDS) < 0) {
+            fprintf(stderr, "benchbatch: batched transfer failed\n");
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nsec_batch = timespec_diff_nsec(&t1, &t0);
+
+    printf("%d boards, %lu cycles, sequential avg %.1f ns, batched avg %.1f ns per cycle\n",
+           FOC_BENCH_BOARDS, cycles, (double)nsec_seq / cycles,
+           (double)nsec_batch / cycles);
+    printf("all boards share %s (one chip select), not a multi-board measurement\n",
+           spimcst.spi_dev);
+}
+
+/*
+ * Start of the step against PWM period of mock UIO device for
+ * timer driven loop, interrupt wait and ADC sequence polling.
+ * Spread of ADC samples per step shows loss of synchronization.
+ */
+void run_uio_sync(unsigned long periods)
+{
+    static const char *mode_name[3] = {"timer", "irq", "poll"};
+    z3pmdrv1_mock_t mock;
+    struct timespec t, now, t_irq;
+    int64_t lat, lat_sum, lat_max;
+    uint32_t sqn_diff, sqn_min, sqn_max;
+    unsigned long i, timeouts;
+    int irq_fd;
+    int mode;
+
+    if (z3pmdrv1_mock_start(&mock, sample_period_nsec, FOC_MOCK_ADC_PER_PERIOD) < 0)
+        exit(1);
+
+    memset(&z3pmcst, 0, sizeof(z3pmcst));
+    z3pmcst.irq_eventfd_fl = 1;
+    z3pmcst.wait_sqn_step = FOC_MOCK_ADC_PER_PERIOD;
+    if (z3pmdrv1_attach(&z3pmcst, dup(mock.regs_fd), dup(mock.irq_fd)) < 0)
+        exit(1);
+    irq_fd = z3pmcst.irq_fd;
+
+    for (mode = 0; mode < 3; mode++) {
+        z3pmcst.irq_fd = mode == 1? irq_fd: -1;
+        lat_sum = lat_max = 0;
+        sqn_min = ~0;
+        sqn_max = 0;
+        timeouts = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        /* The first two periods synchronize the wait */
+        for (i = 0; i < periods + 2; i++) {
+            if (mode == 0) {
+                timespec_add_nsec(&t, sample_period_nsec);
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+            } else if (z3pmdrv1_wait_period(&z3pmcst, FOC_PERIOD_WAIT_USEC) < 0) {
+                timeouts++;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            z3pmdrv1_mock_irq_time(&mock, &t_irq);
+            z3pmcst.curadc_sqn_last = z3pmcst.curadc_sqn;
+            z3pmdrv1_transfer(&z3pmcst);
+            if (i < 2) {
+                z3pmcst.periods_missed = 0;
+                continue;
+            }
+
+            sqn_diff = (z3pmcst.curadc_sqn - z3pmcst.curadc_sqn_last) &
+                       Z3PMDRV1_CURADC_SQN_m;
+            if (sqn_diff < sqn_min)
+                sqn_min = sqn_diff;
+            if (sqn_diff > sqn_max)
+                sqn_max = sqn_diff;
+            lat = timespec_diff_nsec(&now, &t_irq);
+            lat_sum += lat;
+            if (lat > lat_max)
+                lat_max = lat;
+        }
+
+        printf("%-5s ADC samples per step %lu..%lu, start %.1f avg %lld max ns"
+               " after period, missed %lu timeouts %lu\n", mode_name[mode],
+               (unsigned long)sqn_min, (unsigned long)sqn_max,
+               (double)lat_sum / periods, (long long)lat_max,
+               (unsigned long)(mode? z3pmcst.periods_missed: 0), timeouts);
+    }
+
+    z3pmcst.irq_fd = irq_fd;
+    z3pmdrv1_done(&z3pmcst);
+    z3pmdrv1_mock_stop(&mock);
+}
+
+/* Per axis time of separate and batched transfers of mock IP cores */
+void run_bench_axes(unsigned long cycles)
+{
+    z3pmdrv1_mock_t mock[FOC_BENCH_AXES];
+    z3pmdrv1_state_t axes[FOC_BENCH_AXES];
+    z3pmdrv1_state_t *ap[FOC_BENCH_AXES];
+    struct timespec t0, t1;
+    int64_t nsec_seq, nsec_batch;
+    unsigned long i, retries;
+    int a;
+
+    memset(axes, 0, sizeof(axes));
+    for (a = 0; a < FOC_BENCH_AXES; a++) {
+        if (z3pmdrv1_mock_start(&mock[a], sample_period_nsec,
+                                FOC_MOCK_ADC_PER_PERIOD) < 0)
+            exit(1);
+        axes[a].irq_eventfd_fl = 1;
+        if (z3pmdrv1_attach(&axes[a], dup(mock[a].regs_fd),
+                            dup(mock[a].irq_fd)) < 0)
+            exit(1);
+        ap[a] = &axes[a];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < cycles; i++) {
+        for (a = 0; a < FOC_BENCH_AXES; a++) {
+            axes[a].pwm[0] = Z3PMDRV1_PWM_ENABLE | (i & 0xfff);
+            z3pmdrv1_transfer(ap[a]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nsec_seq = timespec_diff_nsec(&t1, &t0);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < cycles; i++) {
+        for (a = 0; a < FOC_BENCH_AXES; a++)
+            axes[a].pwm[0] = Z3PMDRV1_PWM_ENABLE | (i & 0xfff);
+        z3pmdrv1_transfer_batch(ap, FOC_BENCH_AXES);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nsec_batch = timespec_diff_nsec(&t1, &t0);
+
+    for (retries = 0, a = 0; a < FOC_BENCH_AXES; a++) {
+        retries += axes[a].snapshot_retries;
+        z3pmdrv1_done(&axes[a]);
+        z3pmdrv1_mock_stop(&mock[a]);
+    }
+
+    printf("%d axes, %lu cycles, separate %.1f ns, batched %.1f ns per axis,"
+           " snapshot retries %lu\n", FOC_BENCH_AXES, cycles,
+           (double)nsec_seq / cycles / FOC_BENCH_AXES,
+           (double)nsec_batch / cycles / FOC_BENCH_AXES, retries);
+}
+
+/*
+ * Check of rpi_spimc_module exchange, read() paces the loop and its
+ * record is compared with the copy taken from the mapped page.
+ * Shutdown commands are published each frame to feed the watchdog.
+ */
+void run_kmod_monitor(unsigned long frames)
+{
+    static const uint32_t pwm[RPI_SPIMC_CHAN_COUNT] = {
+        SPIMC_PWM_SHUTDOWN, SPIMC_PWM_SHUTDOWN, SPIMC_PWM_SHUTDOWN
+    };
+    volatile struct rpi_spimc_shm *shm;
+    struct rpi_spimc_fb fb, fb_rd;
+    uint64_t time_last = 0;
+    int64_t dev, dev_max = 0;
+    unsigned long i, missed = 0, stale = 0;
+    uint32_t frame_last = 0;
+    int fd;
+
+    fd = open(FOC_KMOD_DEV, O_RDWR);
+    if (fd < 0) {
+        perror("kmodmon open " FOC_KMOD_DEV);
+        exit(1);
+    }
+    shm = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+    if (shm == MAP_FAILED) {
+        perror("kmodmon mmap");
+        exit(1);
+    }
+
+    for (i = 0; i < frames; i++) {
+        rpi_spimc_shm_put_cmd(shm, pwm);
+        if (read(fd, &fb_rd, sizeof(fb_rd)) != sizeof(fb_rd)) {
+            perror("kmodmon read");
+            exit(1);
+        }
+        if ((int32_t)(rpi_spimc_shm_get_fb(shm, &fb) - fb_rd.frame) < 0)
+            stale++;
+        if (i) {
+            missed += fb_rd.frame - frame_last - 1;
+            dev = (int64_t)(fb_rd.time_ns - time_last) -
+                  (int64_t)(fb_rd.frame - frame_last) * shm->period_ns;
+            if (dev < 0)
+                dev = -dev;
+            if (dev > dev_max)
+                dev_max = dev;
+        }
+        frame_last = fb_rd.frame;
+        time_last = fb_rd.time_ns;
+    }
+
+    printf("frames %lu, missed %lu, stale mapped copies %lu, "
+           "max period deviation %lld ns\n", frames, missed, stale,
+           (long long)dev_max);
+    printf("period %lu ns, overruns %lu, spi errors %lu, watchdog trips %lu\n",
+           (unsigned long)shm->period_ns, (unsigned long)shm->overruns,
+           (unsigned long)shm->spi_errors, (unsigned long)shm->watchdog_trips);
+
+    munmap((void *)shm, sysconf(_SC_PAGESIZE));
+    close(fd);
+}
+
+void print_help(FILE *fout)
+{
+    fprintf(fout, "Options:\n");
+    fprintf(fout, "  -z           Zynq 3pmdrv1 driver instead of RPi SPI\n");
+    fprintf(fout, "  -U <dev>     Zynq 3pmdrv1 UIO device, step synchronized to PWM\n");
+    fprintf(fout, "  -B <addr>    Zynq 3pmdrv1 registers base (axis) for /dev/mem access\n");
+    fprintf(fout, "  -D <dev>     SPI device (%s)\n", spimcst.spi_dev);
+    fprintf(fout, "  -f <nsec>    current loop period (%lu)\n",
+            (unsigned long)sample_period_nsec);
+    fprintf(fout, "  -P <pairs>   motor pole pairs (%lu)\n", (unsigned long)pole_pairs);
+    fprintf(fout, "  -I <counts>  IRC counts per revolution (%lu)\n",
+            (unsigned long)irc_per_rev);
+    fprintf(fout, "  -X <counts>  IRC index to electrical zero offset (learned when not set)\n");
+    fprintf(fout, "  -S <hz>      SPI clock (%lu)\n", (unsigned long)SPIMC_SPEED_DEFAULT);
+    fprintf(fout, "  -T <hz>      train SPI link from -S clock up to given one\n");
+    fprintf(fout, "  -A           overlap SPI transfer with computation (one period latency)\n");
+    fprintf(fout, "Possible commands:\n");
+    fprintf(fout, "  align\n");
+    fprintf(fout, "  current <iq>\n");
+    fprintf(fout, "  speed <counts per speed period>\n");
+    fprintf(fout, "  pos <relative counts>\n");
+    fprintf(fout, "  bench [steps]\n");
+    fprintf(fout, "  benchsin [calls]\n");
+    fprintf(fout, "  spitrain\n");
+    fprintf(fout, "  benchpipe [steps]\n");
+    fprintf(fout, "  benchbatch [cycles]\n");
+    fprintf(fout, "  uiosync [periods]\n");
+    fprintf(fout, "  benchaxes [cycles]\n");
+    fprintf(fout, "  kmodmon [frames]\n");
+    fprintf(fout, "  framefuzz [frames]\n");
+    fprintf(fout, "  framebench [frames]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    long value = 0;
+    unsigned long uvalue;
+    char *p;
+    char *argv0 = argv[0];
+    int opt;
+    int mode;
+
+    while ((opt = getopt(argc, argv, "+zAU:B:D:f:P:I:X:S:T:")) != -1) {
+        switch (opt) {
+            case 'z':
+                foc_zynq_fl = 1;
+                break;
+            case 'A':
+                foc_pipeline_fl = 1;
+                break;
+            case 'U':
+                foc_zynq_fl = 1;
+                z3pmcst.uio_dev = optarg;
+                break;
+            case 'D':
+                spimcst.spi_dev = optarg;
+                break;
+            case 'X':
+                index_offset = strtol(optarg, &p, 0);
+                if (optarg == p) {
+                    fprintf(stderr, "%s: -X value parse error\n", argv0);
+                    exit(1);
+                }
+                index_offset_fl = 1;
+                break;
+            case 'f':
+            case 'P':
+            case 'I':
+            case 'S':
+            case 'T':
+            case 'B':
+                uvalue = strtoul(optarg, &p, 0);
+                if ((optarg == p) || !uvalue) {
+                    fprintf(stderr, "%s: -%c value parse error\n", argv0, opt);
+                    exit(1);
+                }
+                if (opt == 'f')
+                    sample_period_nsec = uvalue;
+                else if (opt == 'P')
+                    pole_pairs = uvalue;
+                else if (opt == 'S')
+                    spimcst.spi_speed = uvalue;
+                else if (opt == 'T')
+                    spi_train_max = uvalue;
+                else if (opt == 'B') {
+                    z3pmcst.regs_base_phys = uvalue;
+                    foc_zynq_fl = 1;
+                }
+                else
+                    irc_per_rev = uvalue;
+                break;
+            default:
+                print_help(stderr);
+                exit(1);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+    argv[0] = argv0;
+
+    if (argc < 2) {
+        fprintf(stderr, "%s: at least one argument (command) has to be specified\n"
+                        "Usage: %s [options] <command> [argument]\n",
+                    argv[0], argv[0]);
+        print_help(stderr);
+        exit(1);
+    }
+
+    if (!strcmp(argv[1], "help")) {
+        fprintf(stdout, "Usage: %s [options] <command> [argument]\n", argv[0]);
+        print_help(stdout);
+        return 0;
+    } else if (!strcmp(argv[1], "bench") || !strcmp(argv[1], "benchsin") ||
+               !strcmp(argv[1], "framefuzz") || !strcmp(argv[1], "framebench") ||
+               !strcmp(argv[1], "benchpipe") || !strcmp(argv[1], "benchbatch") ||
+               !strcmp(argv[1], "uiosync") || !strcmp(argv[1], "benchaxes") ||
+               !strcmp(argv[1], "kmodmon")) {
+        uvalue = 1000000;
+        if (argc >= 3) {
+            uvalue = strtoul(argv[2], &p, 0);
+            if ((argv[2] == p) || !uvalue) {
+                fprintf(stderr, "%s: %s count parse error\n", argv[0], argv[1]);
+                exit(1);
+            }
+        }
+        if (!strcmp(argv[1], "bench"))
+            run_bench(uvalue);
+        else if (!strcmp(argv[1], "benchsin"))
+            run_bench_sin(uvalue);
+        else if (!strcmp(argv[1], "framefuzz"))
+            return run_frame_fuzz(uvalue) < 0? 1: 0;
+        else if (!strcmp(argv[1], "benchpipe"))
+            run_bench_pipe(uvalue);
+        else if (!strcmp(argv[1], "benchbatch"))
+            run_bench_batch(uvalue);
+        else if (!strcmp(argv[1], "uiosync"))
+            run_uio_sync(uvalue);
+        else if (!strcmp(argv[1], "benchaxes"))
+            run_bench_axes(uvalue);
+        else if (!strcmp(argv[1], "kmodmon"))
+            run_kmod_monitor(uvalue);
+        else
+            run_frame_bench(uvalue, bench_cpu_hz());
+    } else if (!strcmp(argv[1], "spitrain")) {
+        run_spi_train();
+    } else if (!strcmp(argv[1], "align") || !strcmp(argv[1], "current") ||
+               !strcmp(argv[1], "speed") || !strcmp(argv[1], "pos")) {
+        if (!strcmp(argv[1], "align")) {
+            mode = PMSM_FOC_CURRENT;
+        } else {
+            if (argc < 3) {
+                fprintf(stderr, "%s: %s requires argument\n", argv[0], argv[1]);
+                exit(1);
+            }
+            value = strtol(argv[2], &p, 0);
+            if (argv[2] == p) {
+                fprintf(stderr, "%s: %s value parse error\n", argv[0], argv[1]);
+                exit(1);
+            }
+            if (!strcmp(argv[1], "current")) {
+                mode = PMSM_FOC_CURRENT;
+            } else if (!strcmp(argv[1], "speed")) {
+                mode = PMSM_FOC_SPEED;
+                value <<= PMSM_FOC_SPEED_FRACT;
+            } else {
+                mode = PMSM_FOC_POSITION;
+            }
+        }
+        setup_environment(argv[0]);
+        run_foc(mode, value);
+    } else {
+        fprintf(stderr, "%s: unknown command %s\n"
+                        "Usage: %s [options] <command> [argument]\n",
+                    argv[0], argv[1], argv[0]);
+         print_help(stderr);
+         exit(1);
+    }
+    return 0;
+}
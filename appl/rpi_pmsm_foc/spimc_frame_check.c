@@ -0,0 +1,248 @@
+/*
+ * Check of table driven RPI-MI-1 SPI frame codec against
+ * the original hand written packing code
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "rpi_spimc.h"
+#include "rpi_spimc_frame.h"
+#include "spimc_frame_check.h"
+
+typedef struct frame_ref_rx_t {
+    uint32_t act_pos;
+    uint8_t  hal_sensors;
+    uint32_t idx;
+    uint16_t curadc_sqn;
+    uint32_t curadc_cumsum[SPIMC_CHAN_COUNT];
+} frame_ref_rx_t;
+
+volatile uint32_t frame_bench_sink;
+
+static uint32_t frame_rand_state = 0x12345678;
+
+static inline uint32_t frame_rand(void)
+{
+    uint32_t x = frame_rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    frame_rand_state = x;
+    return x;
+}
+
+/* TX packing as done by spimc_transfer() before table driven codec */
+static void frame_ref_tx_pack(uint8_t *tx, const uint32_t pwm[3])
+{
+    uint32_t pwm1 = pwm[0], pwm2 = pwm[1], pwm3 = pwm[2];
+
+    memset(tx, 0, SPIMC_TRANSFER_SIZE);
+
+    if (pwm1 & SPIMC_PWM_ENABLE)
+        tx[0] |= 1 << 6;
+    if (pwm1 & SPIMC_PWM_SHUTDOWN)
+        tx[0] |= 1 << 3;
+    if (pwm2 & SPIMC_PWM_ENABLE)
+        tx[0] |= 1 << 5;
+    if (pwm2 & SPIMC_PWM_SHUTDOWN)
+        tx[0] |= 1 << 2;
+    if (pwm3 & SPIMC_PWM_ENABLE)
+        tx[0] |= 1 << 4;
+    if (pwm3 & SPIMC_PWM_SHUTDOWN)
+        tx[0] |= 1 << 1;
+
+    pwm1 &= SPIMC_PWM_VALUE_m;
+    pwm2 &= SPIMC_PWM_VALUE_m;
+    pwm3 &= SPIMC_PWM_VALUE_m;
+
+    if (pwm1 > 2047) pwm1 = 2047;
+    if (pwm2 > 2047) pwm2 = 2047;
+    if (pwm3 > 2047) pwm3 = 2047;
+
+    tx[10] = pwm1 >> 8;
+    tx[11] = pwm1 & 0xff;
+    tx[12] = pwm2 >> 8;
+    tx[13] = pwm2 & 0xff;
+    tx[14] = pwm3 >> 8;
+    tx[15] = pwm3 & 0xff;
+}
+
+/* RX unpacking as done by spimc_transfer() before table driven codec */
+static void frame_ref_rx_unpack(frame_ref_rx_t *r, const uint8_t *rx)
+{
+    r->act_pos = ((uint32_t)rx[0] << 24) | ((uint32_t)rx[1] << 16) |
+                 ((uint32_t)rx[2] << 8) | ((uint32_t)rx[3] << 0);
+
+    r->hal_sensors = ((0x80 & rx[4]) >> 7) | ((0x40 & rx[4]) >> 5) |
+                     ((0x20 & rx[4]) >> 3);
+
+    r->idx = 0x1F & rx[4];
+    r->idx <<= 8;
+    r->idx |= 0xFE & rx[5];
+    r->idx >>= 1;
+
+    r->curadc_sqn = 0x01 & rx[5];
+    r->curadc_sqn <<= 8;
+    r->curadc_sqn |= rx[6];
+
+    r->curadc_cumsum[2] = ((uint32_t)rx[7] << 16) | ((uint32_t)rx[8] << 8) | rx[9];
+    r->curadc_cumsum[0] = ((uint32_t)rx[10] << 16) | ((uint32_t)rx[11] << 8) | rx[12];
+    r->curadc_cumsum[1] = ((uint32_t)rx[13] << 16) | ((uint32_t)rx[14] << 8) | rx[15];
+}
+
+/* The same mapping of PWM words to TX fields as spimc_transfer() */
+static inline void frame_tx_fill(spimc_tx_frame_t *f, const uint32_t pwm[3])
+{
+    f->adc_reset = 0;
+    f->pwm1_en = (pwm[0] & SPIMC_PWM_ENABLE)? 1: 0;
+    f->pwm2_en = (pwm[1] & SPIMC_PWM_ENABLE)? 1: 0;
+    f->pwm3_en = (pwm[2] & SPIMC_PWM_ENABLE)? 1: 0;
+    f->pwm1_shdn = (pwm[0] & SPIMC_PWM_SHUTDOWN)? 1: 0;
+    f->pwm2_shdn = (pwm[1] & SPIMC_PWM_SHUTDOWN)? 1: 0;
+    f->pwm3_shdn = (pwm[2] & SPIMC_PWM_SHUTDOWN)? 1: 0;
+    f->pwm1 = (pwm[0] & SPIMC_PWM_VALUE_m) > 2047? 2047: pwm[0] & SPIMC_PWM_VALUE_m;
+    f->pwm2 = (pwm[1] & SPIMC_PWM_VALUE_m) > 2047? 2047: pwm[1] & SPIMC_PWM_VALUE_m;
+    f->pwm3 = (pwm[2] & SPIMC_PWM_VALUE_m) > 2047? 2047: pwm[2] & SPIMC_PWM_VALUE_m;
+}
+
+static void frame_dump(const char *name, const uint8_t *buf)
+{
+    int i;
+
+    fprintf(stderr, "  %s", name);
+    for (i = 0; i < SPIMC_FRAME_SIZE; i++)
+        fprintf(stderr, " %02x", buf[i]);
+    fprintf(stderr, "\n");
+}
+
+/*
+ * Random frames are decoded and encoded by both implementations,
+ * RX frames have to round-trip through emulator side packing.
+ */
+int run_frame_fuzz(unsigned long iterations)
+{
+    uint8_t buf[SPIMC_FRAME_SIZE];
+    uint8_t ref[SPIMC_FRAME_SIZE];
+    uint32_t pwm[3];
+    spimc_tx_frame_t txf, txf2;
+    spimc_rx_frame_t rxf;
+    frame_ref_rx_t r;
+    unsigned long i;
+    int j;
+
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < SPIMC_FRAME_SIZE; j++)
+            buf[j] = frame_rand();
+        memcpy(ref, buf, SPIMC_FRAME_SIZE);
+
+        spimc_rx_frame_unpack(&rxf, buf);
+        frame_ref_rx_unpack(&r, buf);
+        if ((rxf.irc_pos != r.act_pos) ||
+            ((rxf.hal1 | (rxf.hal2 << 1) | (rxf.hal3 << 2)) != r.hal_sensors) ||
+            (rxf.index_pos != r.idx) || (rxf.adc_sqn != r.curadc_sqn) ||
+            (rxf.adc_sum0 != r.curadc_cumsum[0]) ||
+            (rxf.adc_sum1 != r.curadc_cumsum[1]) ||
+            (rxf.adc_sum2 != r.curadc_cumsum[2])) {
+            fprintf(stderr, "framefuzz: RX unpack mismatch at %lu\n", i);
+            frame_dump("rx", buf);
+            return -1;
+        }
+
+        spimc_rx_frame_pack(buf, &rxf);
+        if (memcmp(buf, ref, SPIMC_FRAME_SIZE)) {
+            fprintf(stderr, "framefuzz: RX round-trip mismatch at %lu\n", i);
+            frame_dump("in ", ref);
+            frame_dump("out", buf);
+            return -1;
+        }
+
+        for (j = 0; j < 3; j++)
+            pwm[j] = frame_rand() & (SPIMC_PWM_VALUE_m | SPIMC_PWM_ENABLE |
+                                     SPIMC_PWM_SHUTDOWN);
+        frame_ref_tx_pack(ref, pwm);
+        frame_tx_fill(&txf, pwm);
+        spimc_tx_frame_pack(buf, &txf);
+        if (memcmp(buf, ref, SPIMC_FRAME_SIZE)) {
+            fprintf(stderr, "framefuzz: TX pack mismatch at %lu\n", i);
+            frame_dump("ref", ref);
+            frame_dump("new", buf);
+            return -1;
+        }
+
+        spimc_tx_frame_unpack(&txf2, buf);
+        if (memcmp(&txf, &txf2, sizeof(txf))) {
+            fprintf(stderr, "framefuzz: TX round-trip mismatch at %lu\n", i);
+            frame_dump("tx", buf);
+            return -1;
+        }
+    }
+
+    printf("framefuzz: %lu TX and RX frames match\n", iterations);
+
+    return 0;
+}
+
+static void frame_bench_report(const char *name, int64_t nsec,
+                               unsigned long frames, double cpu_hz)
+{
+    printf("%-8s %6.2f ns", name, (double)nsec / frames);
+    if (cpu_hz)
+        printf("  %6.1f cycles", nsec * 1e-9 * cpu_hz / frames);
+    printf(" per frame\n");
+}
+
+/* Cost of TX pack and RX unpack of one transfer for both codecs */
+void run_frame_bench(unsigned long frames, double cpu_hz)
+{
+    uint8_t tx[SPIMC_FRAME_SIZE];
+    uint8_t rx[SPIMC_FRAME_SIZE];
+    static uint8_t rx_src[SPIMC_FRAME_SIZE];
+    uint32_t pwm[3] = {SPIMC_PWM_ENABLE, SPIMC_PWM_ENABLE, SPIMC_PWM_SHUTDOWN};
+    spimc_tx_frame_t txf;
+    spimc_rx_frame_t rxf;
+    frame_ref_rx_t r;
+    struct timespec t0, t1;
+    uint32_t sum;
+    unsigned long i;
+    int j;
+
+    for (j = 0; j < SPIMC_FRAME_SIZE; j++)
+        rx_src[j] = frame_rand();
+
+    /* Transfer is replaced by copy of the prepared RX frame */
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (sum = 0, i = 0; i < frames; i++) {
+        pwm[0] = SPIMC_PWM_ENABLE | (i & 0x7ff);
+        frame_ref_tx_pack(tx, pwm);
+        rx_src[3] = i;
+        memset(rx, 0, SPIMC_FRAME_SIZE);
+        memcpy(rx, rx_src, SPIMC_FRAME_SIZE);
+        frame_ref_rx_unpack(&r, rx);
+        sum += r.act_pos + r.idx + r.curadc_sqn + r.curadc_cumsum[0] + tx[11];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    frame_bench_sink = sum;
+    frame_bench_report("manual", (int64_t)(t1.tv_sec - t0.tv_sec) * 1000000000 +
+                       (t1.tv_nsec - t0.tv_nsec), frames, cpu_hz);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (sum = 0, i = 0; i < frames; i++) {
+        pwm[0] = SPIMC_PWM_ENABLE | (i & 0x7ff);
+        frame_tx_fill(&txf, pwm);
+        spimc_tx_frame_pack(tx, &txf);
+        rx_src[3] = i;
+        memcpy(rx, rx_src, SPIMC_FRAME_SIZE);
+        spimc_rx_frame_unpack(&rxf, rx);
+        sum += rxf.irc_pos + rxf.index_pos + rxf.adc_sqn + rxf.adc_sum0 + tx[11];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    frame_bench_sink = sum;
+    frame_bench_report("table", (int64_t)(t1.tv_sec - t0.tv_sec) * 1000000000 +
+                       (t1.tv_nsec - t0.tv_nsec), frames, cpu_hz);
+}
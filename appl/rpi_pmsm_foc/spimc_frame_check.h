@@ -0,0 +1,9 @@
+#ifndef _SPIMC_FRAME_CHECK_H
+#define _SPIMC_FRAME_CHECK_H
+
+/* Returns -1 when table driven and original codecs differ */
+int run_frame_fuzz(unsigned long iterations);
+
+void run_frame_bench(unsigned long frames, double cpu_hz);
+
+#endif /*_SPIMC_FRAME_CHECK_H*/
@@ -0,0 +1,133 @@
+/*
+ * Mock of Zynq 3pmdrv1 UIO device for tests without hardware
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include "zynq_3pmdrv1_regs.h"
+#include "zynq_uio_mock.h"
+
+/* Mid-scale reading of 12-bit current ADCs */
+#define Z3PMDRV1_MOCK_ADC_ZERO  2048
+
+static inline uint32_t *mock_reg(z3pmdrv1_mock_t *mock, unsigned reg_offs)
+{
+    return (uint32_t *)((char *)mock->regs + reg_offs);
+}
+
+static void *z3pmdrv1_mock_thread(void *arg)
+{
+    z3pmdrv1_mock_t *mock = arg;
+    struct timespec t;
+    uint64_t one = 1;
+    uint32_t *sqn_stat = mock_reg(mock, Z3PMDRV1_REG_ADC_SQN_STAT_o);
+    uint32_t *adc[3] = {
+        mock_reg(mock, Z3PMDRV1_REG_ADC1_o),
+        mock_reg(mock, Z3PMDRV1_REG_ADC2_o),
+        mock_reg(mock, Z3PMDRV1_REG_ADC3_o),
+    };
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    while (!mock->quit) {
+        t.tv_nsec += mock->period_nsec;
+        while (t.tv_nsec >= 1000000000) {
+            t.tv_nsec -= 1000000000;
+            t.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL);
+
+        for (i = 0; i < 3; i++)
+            __atomic_store_n(adc[i], (*adc[i] + Z3PMDRV1_MOCK_ADC_ZERO *
+                             mock->adc_per_period) & 0xffffff, __ATOMIC_RELAXED);
+        __atomic_store_n(sqn_stat, (*sqn_stat & ~Z3PMDRV1_REG_ADSQST_SQN_m) |
+                         ((*sqn_stat + mock->adc_per_period) &
+                          Z3PMDRV1_REG_ADSQST_SQN_m), __ATOMIC_RELEASE);
+
+        __atomic_add_fetch(&mock->irq_seq, 1, __ATOMIC_RELEASE);
+        clock_gettime(CLOCK_MONOTONIC, &mock->irq_time);
+        __atomic_add_fetch(&mock->irq_seq, 1, __ATOMIC_RELEASE);
+
+        if (write(mock->irq_fd, &one, sizeof(one)) != sizeof(one))
+            break;
+    }
+
+    return NULL;
+}
+
+int z3pmdrv1_mock_start(z3pmdrv1_mock_t *mock, uint32_t period_nsec,
+                        uint32_t adc_per_period)
+{
+    void *mm;
+
+    memset(mock, 0, sizeof(*mock));
+    mock->period_nsec = period_nsec;
+    mock->adc_per_period = adc_per_period;
+
+    mock->regs_fd = memfd_create("z3pmdrv1_mock", 0);
+    if (mock->regs_fd < 0) {
+        perror("memfd_create");
+        return -1;
+    }
+    if (ftruncate(mock->regs_fd, Z3PMDRV1_REG_SIZE) < 0) {
+        perror("ftruncate");
+        close(mock->regs_fd);
+        return -1;
+    }
+    mm = mmap(NULL, Z3PMDRV1_REG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+              mock->regs_fd, 0);
+    if (mm == MAP_FAILED) {
+        perror("mmap");
+        close(mock->regs_fd);
+        return -1;
+    }
+    mock->regs = mm;
+
+    mock->irq_fd = eventfd(0, 0);
+    if (mock->irq_fd < 0) {
+        perror("eventfd");
+        munmap(mm, Z3PMDRV1_REG_SIZE);
+        close(mock->regs_fd);
+        return -1;
+    }
+
+    if (pthread_create(&mock->thread, NULL, z3pmdrv1_mock_thread, mock) != 0) {
+        fprintf(stderr, "cannot start mock device thread\n");
+        close(mock->irq_fd);
+        munmap(mm, Z3PMDRV1_REG_SIZE);
+        close(mock->regs_fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+void z3pmdrv1_mock_stop(z3pmdrv1_mock_t *mock)
+{
+    mock->quit = 1;
+    pthread_join(mock->thread, NULL);
+    close(mock->irq_fd);
+    munmap((void *)mock->regs, Z3PMDRV1_REG_SIZE);
+    close(mock->regs_fd);
+}
+
+void z3pmdrv1_mock_irq_time(z3pmdrv1_mock_t *mock, struct timespec *t)
+{
+    uint32_t seq;
+
+    do {
+        seq = __atomic_load_n(&mock->irq_seq, __ATOMIC_ACQUIRE);
+        *t = mock->irq_time;
+    } while ((seq & 1) || (seq != __atomic_load_n(&mock->irq_seq, __ATOMIC_ACQUIRE)));
+}
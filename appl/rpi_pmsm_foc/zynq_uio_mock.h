@@ -0,0 +1,34 @@
+#ifndef _ZYNQ_UIO_MOCK_H
+#define _ZYNQ_UIO_MOCK_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Mock of 3pmdrv1 UIO device, register window is memfd and
+ * PWM period interrupt is signalled through eventfd. The thread
+ * advances ADC sequence number and sums each period and then
+ * raises the interrupt.
+ */
+typedef struct z3pmdrv1_mock_t {
+    int      regs_fd;
+    int      irq_fd;
+    volatile uint32_t *regs;
+    uint32_t period_nsec;
+    uint32_t adc_per_period;
+    pthread_t thread;
+    volatile int quit;
+    /* time of the last interrupt, odd seq while it is updated */
+    volatile uint32_t irq_seq;
+    struct timespec irq_time;
+} z3pmdrv1_mock_t;
+
+int z3pmdrv1_mock_start(z3pmdrv1_mock_t *mock, uint32_t period_nsec,
+                        uint32_t adc_per_period);
+
+void z3pmdrv1_mock_stop(z3pmdrv1_mock_t *mock);
+
+void z3pmdrv1_mock_irq_time(z3pmdrv1_mock_t *mock, struct timespec *t);
+
+#endif /*_ZYNQ_UIO_MOCK_H*/
@@ -0,0 +1,96 @@
+/*
+ * Simulated DC motor plant for rpi_simple_dc_servo
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * The model allows to run controler_step() without Raspberry Pi,
+ * motor and encoder. It is advanced in lock-step with
+ * the controller so the loop runs as fast as CPU allows.
+ *
+ *   u = supply_voltage * pwm / pwm_period
+ *   L di/dt = u - R i - ke omega
+ *   J domega/dt = kt i - b omega - Tc sign(omega) - Tload
+ *   irc = floor(theta * irc_per_rev / (2 pi))
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "dc_motor_sim.h"
+
+void dc_motor_sim_init(dc_motor_sim_t *sim, uint32_t sample_period_nsec)
+{
+    memset(sim, 0, sizeof(*sim));
+
+    /* Small 12 V motor with 500 lines encoder */
+    sim->supply_voltage = 12.0;
+    sim->pwm_period = 4000;
+    sim->resistance = 2.0;
+    sim->inductance = 1e-3;
+    sim->ke = 0.02;
+    sim->kt = 0.02;
+    sim->inertia = 1e-5;
+    sim->viscous_friction = 1e-6;
+    sim->coulomb_friction = 2e-3;
+    sim->load_torque = 0;
+    sim->irc_per_rev = 2000;
+    sim->period = sample_period_nsec * 1e-9;
+    sim->substeps = 10;
+}
+
+/* Same saturation as rpi_bidirpwm_output_set_width() */
+void dc_motor_sim_set_pwm(dc_motor_sim_t *sim, int value)
+{
+    if (value > sim->pwm_period)
+        value = sim->pwm_period;
+    else if (value < -sim->pwm_period)
+        value = -sim->pwm_period;
+    sim->pwm_value = value;
+}
+
+uint32_t dc_motor_sim_read_irc(dc_motor_sim_t *sim)
+{
+    double counts = floor(sim->theta * sim->irc_per_rev / (2 * M_PI));
+
+    return (uint32_t)(int64_t)counts;
+}
+
+void dc_motor_sim_advance(dc_motor_sim_t *sim)
+{
+    int i;
+    double dt = sim->period / sim->substeps;
+    double u = sim->supply_voltage * sim->pwm_value / sim->pwm_period;
+    double torque;
+    double omega_new;
+
+    for (i = 0; i < sim->substeps; i++) {
+        sim->current += (u - sim->resistance * sim->current -
+                         sim->ke * sim->omega) / sim->inductance * dt;
+
+        torque = sim->kt * sim->current - sim->viscous_friction * sim->omega -
+                 sim->load_torque;
+
+        if (sim->omega > 0) {
+            torque -= sim->coulomb_friction;
+        } else if (sim->omega < 0) {
+            torque += sim->coulomb_friction;
+        } else if (fabs(torque) <= sim->coulomb_friction) {
+            /* static friction holds the shaft */
+            continue;
+        } else {
+            torque -= torque > 0? sim->coulomb_friction: -sim->coulomb_friction;
+        }
+
+        omega_new = sim->omega + torque / sim->inertia * dt;
+
+        /* Coulomb friction cannot reverse motion direction */
+        if ((sim->omega > 0 && omega_new < 0) ||
+            (sim->omega < 0 && omega_new > 0))
+            omega_new = 0;
+
+        sim->theta += (sim->omega + omega_new) / 2 * dt;
+        sim->omega = omega_new;
+    }
+    sim->steps++;
+}
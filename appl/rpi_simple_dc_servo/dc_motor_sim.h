@@ -0,0 +1,42 @@
+#ifndef _DC_MOTOR_SIM_H
+#define _DC_MOTOR_SIM_H
+
+#include <stdint.h>
+
+/*
+ * Discrete model of DC motor with load, PWM power stage
+ * and quadrature encoder. It replaces rpi_bidirpwm_set()
+ * and irc_dev_read() when the servo runs without hardware.
+ */
+typedef struct dc_motor_sim_t {
+    /* parameters */
+    double supply_voltage;   /* H-bridge voltage at 100% duty [V] */
+    int    pwm_period;       /* PWM value corresponding to 100% duty */
+    double resistance;       /* winding resistance [Ohm] */
+    double inductance;       /* winding inductance [H] */
+    double ke;               /* back-EMF constant [V s/rad] */
+    double kt;               /* torque constant [N m/A] */
+    double inertia;          /* rotor and load inertia [kg m^2] */
+    double viscous_friction; /* [N m s/rad] */
+    double coulomb_friction; /* [N m] */
+    double load_torque;      /* external load torque [N m] */
+    double irc_per_rev;      /* encoder counts per revolution (4x decoded) */
+    double period;           /* simulated sample period [s] */
+    int    substeps;         /* integration steps per sample period */
+    /* state */
+    int    pwm_value;
+    double current;
+    double omega;
+    double theta;
+    uint64_t steps;
+} dc_motor_sim_t;
+
+void dc_motor_sim_init(dc_motor_sim_t *sim, uint32_t sample_period_nsec);
+
+void dc_motor_sim_set_pwm(dc_motor_sim_t *sim, int value);
+
+uint32_t dc_motor_sim_read_irc(dc_motor_sim_t *sim);
+
+void dc_motor_sim_advance(dc_motor_sim_t *sim);
+
+#endif /*_DC_MOTOR_SIM_H*/
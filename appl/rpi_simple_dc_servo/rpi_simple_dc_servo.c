@@ -33,6 +33,7 @@
  *    impelmentation under author lead
  */
 
+#define _GNU_SOURCE
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -45,8 +46,25 @@
 #include <sys/mman.h>  /* this provides mlockall() */
 #include <pthread.h>
 #include <signal.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "rpi_bidirpwm.h"
+#include "dc_motor_sim.h"
+#include "servo_params.h"
+#include "servo_ctl.h"
+#include "rt_launch.h"
+#include "servo_perf.h"
+#include "servo_traj.h"
+#include "servo_move.h"
+#include "servo_obs.h"
+#include "servo_ident.h"
+#include "servo_scope.h"
 
 char *irc_dev_name = "/dev/irc0";
 int irc_dev_fd;
@@ -67,6 +85,76 @@ uint32_t pwm_max = 2000;
 uint32_t sample_period_nsec = 1000 * 1000;
 struct timespec sample_period_time;
 struct timespec monitor_period_time;
+int sim_plant_fl;
+int sim_lockstep_fl;
+dc_motor_sim_t sim_plant;
+servo_params_shm_t *servo_params_shm;
+uint32_t servo_params_version;
+servo_ctl_shm_t *servo_ctl_shm;
+uint32_t servo_periods;
+uint32_t servo_cmds_done;
+int rt_sched_deadline_fl;
+int rt_deadline_runtime_pct = 30;
+int rt_cpu = -1;
+uint32_t rt_warmup_periods = 1000;
+long rt_faults_base;
+volatile long rt_warmup_faults = -1;
+enum servo_ref_mode_t {
+    SERVO_REF_SPEED = 0,
+    SERVO_REF_TRAJ,
+    SERVO_REF_MOVE,
+    SERVO_REF_VEL,
+};
+
+volatile int servo_ref_mode = SERVO_REF_SPEED;
+servo_traj_shm_t *servo_traj_shm;
+servo_traj_state_t servo_traj_state;
+servo_move_t servo_move;
+servo_obs_t servo_obs;
+int servo_obs_d_fl;
+int servo_obs_pos_shift = 2;
+int servo_obs_vel_shift = 5;
+int64_t ref_vel_fract;
+uint64_t ref_pos_fract_prev;
+int32_t vel_ctrl_p = 100;
+int32_t vel_ctrl_i = 5;
+int32_t vel_ctrl_i_sum;
+servo_ident_t *servo_ident;
+int servo_ident_ref_fl;
+int32_t ctrl_action_inj;
+int servo_scope_fl;
+servo_scope_t servo_scope;
+int servo_perf_fl;
+servo_perf_t servo_perf;
+const char *ctl_socket_path = SERVO_CTL_SOCKET_PATH;
+int wake_spin_fl;
+int wake_guard_auto_fl;
+int32_t wake_guard_nsec;
+int32_t wake_guard_max_nsec;
+
+/* SCHED_DEADLINE runtime kept for the control step itself, percent of period */
+#define RT_STEP_BUDGET_PCT  10
+
+/* Wake-up statistics collected by RT task, reset on monitor request */
+typedef struct wake_stats_t {
+    uint32_t count;
+    int32_t  late_min;
+    int32_t  late_max;
+    int64_t  late_sum;
+    int64_t  spin_sum;
+    int32_t  overshoot_max;
+} wake_stats_t;
+
+wake_stats_t wake_stats;
+volatile int wake_stats_reset_req = 1;
+int32_t wake_last_late;
+
+typedef struct rt_task_launch_t {
+    void *(*start_routine) (void *);
+    void *arg;
+    sem_t started;
+    int ret;
+} rt_task_launch_t;
 
 int irc_dev_init(void)
 {
@@ -79,18 +167,66 @@ int irc_dev_init(void)
 
 int irc_dev_read(uint32_t *irc_val)
 {
+    if (sim_plant_fl) {
+        *irc_val = dc_motor_sim_read_irc(&sim_plant);
+        return 0;
+    }
     if (read(irc_dev_fd, irc_val, sizeof(uint32_t)) != sizeof(uint32_t)) {
         return -1;
     }
     return 0;
 }
 
+int pwm_output_set(int value)
+{
+    if (sim_plant_fl) {
+        dc_motor_sim_set_pwm(&sim_plant, value);
+        return 0;
+    }
+    return rpi_bidirpwm_set(value);
+}
+
+static inline int rt_isolated_launch(void)
+{
+    return rt_sched_deadline_fl || (rt_cpu >= 0);
+}
+
+/*
+ * Entry of the task started in isolated mode. Switches to
+ * SCHED_DEADLINE if requested, pre-faults stack and records
+ * page faults base for warmup check.
+ */
+static void *rt_task_trampoline(void *p)
+{
+    rt_task_launch_t *launch = (rt_task_launch_t *)p;
+    void *(*start_routine) (void *) = launch->start_routine;
+    void *arg = launch->arg;
+    int ret = 0;
+
+    if (rt_sched_deadline_fl) {
+        uint64_t runtime = (uint64_t)sample_period_nsec * rt_deadline_runtime_pct / 100;
+        ret = rt_launch_set_deadline(runtime, sample_period_nsec, sample_period_nsec);
+    }
+
+    rt_launch_prefault_stack(RT_LAUNCH_STACK_SIZE - 64 * 1024);
+    rt_faults_base = rt_launch_thread_faults();
+
+    launch->ret = ret;
+    sem_post(&launch->started);
+
+    if (ret != 0)
+        return NULL;
+
+    return start_routine(arg);
+}
+
 int create_rt_task(pthread_t *thread, int prio, void *(*start_routine) (void *), void *arg)
 {
     int ret ;
 
     pthread_attr_t attr;
     struct sched_param schparam;
+    rt_task_launch_t launch;
 
     /* Initialize pthread attribute structure by default parameters */
     if (pthread_attr_init(&attr) != 0) {
@@ -98,43 +234,140 @@ int create_rt_task(pthread_t *thread, int prio, void *(*start_routine) (void *),
         return -1;
     }
 
-    /* Request to switch to specified policy at thread start */
-    if (pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED) != 0) {
-        fprintf(stderr, "pthread_attr_setinheritsched failed\n");
-        return -1;
+    if (rt_isolated_launch()) {
+        /* Fixed stack size which is pre-faulted at task start */
+        if (pthread_attr_setstacksize(&attr, RT_LAUNCH_STACK_SIZE) != 0) {
+            fprintf(stderr, "pthread_attr_setstacksize failed\n");
+            return -1;
+        }
     }
 
-    /* Select RT aware policy */
-    if (pthread_attr_setschedpolicy(&attr, SCHED_FIFO) != 0) {
-        fprintf(stderr, "pthread_attr_setschedpolicy SCHED_FIFO failed\n");
-        return -1;
+    /*
+     * SCHED_DEADLINE is refused (EPERM) for affinity narrower than
+     * the root domain, with -d the CPU has to be provided by exclusive
+     * cpuset partition the program is started in
+     */
+    if ((rt_cpu >= 0) && !rt_sched_deadline_fl) {
+        cpu_set_t cpuset;
+
+        CPU_ZERO(&cpuset);
+        CPU_SET(rt_cpu, &cpuset);
+        if (pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset) != 0) {
+            fprintf(stderr, "pthread_attr_setaffinity_np failed\n");
+            return -1;
+        }
     }
 
-    /* Select priority within selected policy */
-    schparam.sched_priority = prio;
+    /* SCHED_DEADLINE is set by the task itself in rt_task_trampoline */
+    if (!rt_sched_deadline_fl) {
+        /* Request to switch to specified policy at thread start */
+        if (pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED) != 0) {
+            fprintf(stderr, "pthread_attr_setinheritsched failed\n");
+            return -1;
+        }
 
-    /* Check priority parameter setup to the structure */
-    if (pthread_attr_setschedparam(&attr, &schparam) != 0) {
-        fprintf(stderr, "pthread_attr_setschedparam failed\n");
-        return -1;
+        /* Select RT aware policy */
+        if (pthread_attr_setschedpolicy(&attr, SCHED_FIFO) != 0) {
+            fprintf(stderr, "pthread_attr_setschedpolicy SCHED_FIFO failed\n");
+            return -1;
+        }
+
+        /* Select priority within selected policy */
+        schparam.sched_priority = prio;
+
+        /* Check priority parameter setup to the structure */
+        if (pthread_attr_setschedparam(&attr, &schparam) != 0) {
+            fprintf(stderr, "pthread_attr_setschedparam failed\n");
+            return -1;
+        }
+    }
+
+    if (!rt_isolated_launch()) {
+        /* Create new thread with specified parameters and start it */
+        ret = pthread_create(thread, &attr, start_routine, arg);
+
+        /* Release unneeded parameters structure */
+        pthread_attr_destroy(&attr);
+
+        return ret;
     }
 
-    /* Create new thread with specified parameters and start it */
-    ret = pthread_create(thread, &attr, start_routine, arg);
+    launch.start_routine = start_routine;
+    launch.arg = arg;
+    launch.ret = -1;
+    sem_init(&launch.started, 0, 0);
 
-    /* Release unneeded parameters structure */
+    ret = pthread_create(thread, &attr, rt_task_trampoline, &launch);
     pthread_attr_destroy(&attr);
 
+    if (ret == 0) {
+        /* Wait until the task finishes scheduling setup */
+        while (sem_wait(&launch.started) == -1)
+            ;
+        ret = launch.ret;
+        if (ret != 0)
+            pthread_join(*thread, NULL);
+    }
+    sem_destroy(&launch.started);
+
     return ret;
 }
 
-int controler_step(uint32_t rp)
+void servo_params_get(servo_params_t *prm)
+{
+    prm->ctrl_p = ctrl_p;
+    prm->ctrl_i = ctrl_i;
+    prm->ctrl_d = ctrl_d;
+    prm->pwm_max = pwm_max;
+    prm->sample_period_nsec = sample_period_nsec;
+    prm->flags = 0;
+}
+
+/*
+ * Swap to parameters published by the tuning tool,
+ * called at the period boundary from RT task.
+ */
+void servo_params_update(void)
+{
+    servo_params_t prm;
+    int64_t i_sum;
+
+    if (servo_params_shm == NULL)
+        return;
+
+    if (!servo_params_poll(servo_params_shm, &prm, &servo_params_version))
+        return;
+
+    if (prm.flags & SERVO_PARAMS_BUMPLESS) {
+        /*
+         * Keep proportional part of the action unchanged
+         * for the last error, difference component change
+         * is only transient and is not compensated.
+         */
+        i_sum = ctrl_i_sum +
+                (int64_t)(ctrl_p - prm.ctrl_p) * ctrl_err_last;
+        if (i_sum > INT32_MAX)
+            i_sum = INT32_MAX;
+        else if (i_sum < INT32_MIN)
+            i_sum = INT32_MIN;
+        ctrl_i_sum = i_sum;
+    }
+
+    ctrl_p = prm.ctrl_p;
+    ctrl_i = prm.ctrl_i;
+    ctrl_d = prm.ctrl_d;
+    pwm_max = prm.pwm_max;
+    servo_scope.act_limit = pwm_max;
+    /*
+     * Sample period is not swapped, SCHED_DEADLINE reservation,
+     * simulated plant, perf window and scope limits are derived
+     * from it at start. set_params() rejects the change.
+     */
+}
+
+static inline uint32_t plant_state_read(void)
 {
     uint32_t ap, lp;
-    int32_t err;
-    int32_t action;
-    int fract_bits = 8;
-    uint32_t act_max = pwm_max << fract_bits;
 
     irc_dev_read(&ap);
     ap += pos_offset;
@@ -143,6 +376,48 @@ int controler_step(uint32_t rp)
     act_pos = ap;
     act_speed = (int32_t)(ap - lp);
 
+    servo_obs_update(&servo_obs, ap);
+
+    return ap;
+}
+
+/* Difference of reference and observer velocity in counts per sample, 8 fractional bits */
+static inline int32_t obs_speed_err(int64_t ref_vel)
+{
+    int64_t err = (ref_vel - servo_obs.vel_fract) >> 24;
+
+    if (err > 0x7fff)
+        err = 0x7fff;
+    else if (err < -0x7fff)
+        err = -0x7fff;
+
+    return err;
+}
+
+/* Excitation is added behind anti-windup to not wind the integrator */
+static inline void controler_output(int32_t action)
+{
+    action += ctrl_action_inj;
+    if (action > (int32_t)pwm_max)
+        action = pwm_max;
+    else if (action < -(int32_t)pwm_max)
+        action = -pwm_max;
+
+    ctrl_action = action;
+    pwm_output_set(action);
+}
+
+int controler_step(uint32_t rp)
+{
+    uint32_t ap;
+    int32_t err;
+    int32_t d_err;
+    int32_t action;
+    int fract_bits = 8;
+    uint32_t act_max = pwm_max << fract_bits;
+
+    ap = plant_state_read();
+
     /* Difference between setpoint and plant state */
     err = (int32_t)(rp - ap);
 
@@ -164,11 +439,19 @@ int controler_step(uint32_t rp)
         ctrl_i_sum += err * ctrl_i;
     }
 
+    /*
+     * Difference of the error computed from counts is quantized,
+     * the observer provides sub-count velocity estimate instead.
+     */
+    if (servo_obs_d_fl)
+        d_err = (ctrl_d * obs_speed_err(ref_vel_fract)) >> fract_bits;
+    else
+        d_err = ctrl_d * (err - ctrl_err_last);
+
     /* Compute control action */
     action = ctrl_p * err + /* proportional component */
              ctrl_i_sum +   /* "integral" component */
-                 /* difference/"derivative" component */
-             ctrl_d * (err - ctrl_err_last);
+             d_err;         /* difference/"derivative" component */
 
     /* Store error value for difference computation in next iteration */
     ctrl_err_last = err;
@@ -190,26 +473,202 @@ int controler_step(uint32_t rp)
     * Scale the action value to enable computation
     * in fixed/integer arithmetic format
     */
-    ctrl_action = action >> fract_bits;
-    rpi_bidirpwm_set(action >> fract_bits);
+    controler_output(action >> fract_bits);
+
+    return 0;
+}
+
+/* PI speed loop closed over the observer velocity estimate */
+int velocity_controler_step(int64_t ref_vel)
+{
+    int32_t err;
+    int32_t action;
+    int fract_bits = 8;
+    uint32_t act_max = pwm_max << fract_bits;
+
+    plant_state_read();
+
+    err = obs_speed_err(ref_vel);
+
+    vel_ctrl_i_sum += err * vel_ctrl_i;
+
+    action = vel_ctrl_p * err + vel_ctrl_i_sum;
+
+    /* Anti-windup algorithm */
+    if (action >= 0) {
+        if (action > act_max) {
+            vel_ctrl_i_sum -= action - act_max;
+            action = act_max;
+        }
+    } else {
+        if (-action > act_max) {
+            vel_ctrl_i_sum -= action + act_max;
+            action = -act_max;
+        }
+    }
+
+    controler_output(action >> fract_bits);
+
+    return 0;
+}
+
+
+static inline int64_t timespec_diff_nsec(const struct timespec *a,
+                                         const struct timespec *b)
+{
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 +
+           (a->tv_nsec - b->tv_nsec);
+}
+
+static inline void timespec_add_nsec(struct timespec *t, int64_t nsec)
+{
+    nsec += t->tv_nsec;
+    t->tv_sec += nsec / 1000000000;
+    nsec %= 1000000000;
+    if (nsec < 0) {
+        nsec += 1000000000;
+        t->tv_sec -= 1;
+    }
+    t->tv_nsec = nsec;
+}
+
+/*
+ * Guard band follows the worst sleep overshoot quickly and decays
+ * slowly (1/1024 per period) when the system becomes quieter.
+ */
+static inline void wake_guard_calibrate(int32_t overshoot)
+{
+    int32_t guard = wake_guard_nsec - (wake_guard_nsec >> 10);
+    int32_t guard_max = wake_guard_max_nsec;
+
+    overshoot += overshoot / 4 + 2000;
+    if (guard < overshoot)
+        guard = overshoot;
+    if (guard > guard_max)
+        guard = guard_max;
+    wake_guard_nsec = guard;
+}
+
+/*
+ * Spinning consumes SCHED_DEADLINE runtime, the guard band has to leave
+ * budget for the step, otherwise the task is throttled before it runs.
+ */
+static int wake_guard_limit_setup(const char *argv0)
+{
+    int32_t runtime;
+
+    wake_guard_max_nsec = sample_period_nsec / 2;
+
+    if (!rt_sched_deadline_fl)
+        return 0;
+
+    runtime = (uint64_t)sample_period_nsec * rt_deadline_runtime_pct / 100;
+    runtime -= (uint64_t)sample_period_nsec * RT_STEP_BUDGET_PCT / 100;
+    if (runtime <= 0) {
+        fprintf(stderr, "%s: -g requires SCHED_DEADLINE runtime over %d%% of period\n",
+                argv0, RT_STEP_BUDGET_PCT);
+        return -1;
+    }
+    if (wake_guard_max_nsec > runtime)
+        wake_guard_max_nsec = runtime;
+
+    if (wake_guard_nsec > wake_guard_max_nsec) {
+        fprintf(stderr, "%s: guard band limited to %ld ns by SCHED_DEADLINE runtime\n",
+                argv0, (long)wake_guard_max_nsec);
+        wake_guard_nsec = wake_guard_max_nsec;
+    }
 
     return 0;
 }
 
+static inline void wake_stats_update(int32_t late, int32_t spin, int32_t overshoot)
+{
+    if (wake_stats_reset_req) {
+        memset(&wake_stats, 0, sizeof(wake_stats));
+        wake_stats.late_min = INT32_MAX;
+        wake_stats.late_max = INT32_MIN;
+        wake_stats_reset_req = 0;
+    }
+    wake_stats.count++;
+    wake_stats.late_sum += late;
+    wake_stats.spin_sum += spin;
+    if (late < wake_stats.late_min)
+        wake_stats.late_min = late;
+    if (late > wake_stats.late_max)
+        wake_stats.late_max = late;
+    if (overshoot > wake_stats.overshoot_max)
+        wake_stats.overshoot_max = overshoot;
+}
 
+/*
+ * Plain mode sleeps to the deadline. Hybrid mode sleeps until
+ * the deadline minus guard band and then spins on CLOCK_MONOTONIC
+ * (vDSO, no syscall) to cut wake-up latency jitter.
+ */
 void wait_next_period(void)
 {
-    sample_period_time.tv_nsec += sample_period_nsec;
-    if (sample_period_time.tv_nsec > 1000*1000*1000) {
-        sample_period_time.tv_nsec -= 1000*1000*1000;
-        sample_period_time.tv_sec += 1;
+    struct timespec wake_time;
+    struct timespec now;
+    int32_t overshoot;
+    int32_t late;
+
+    if (sim_plant_fl) {
+        dc_motor_sim_advance(&sim_plant);
+        /* Simulated plant runs in lock-step, no waiting */
+        if (sim_lockstep_fl)
+            return;
+    }
+
+    timespec_add_nsec(&sample_period_time, sample_period_nsec);
+
+    if (!wake_spin_fl) {
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sample_period_time, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        late = timespec_diff_nsec(&now, &sample_period_time);
+        wake_stats_update(late, 0, late);
+        wake_last_late = late;
+        return;
     }
-    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &sample_period_time, NULL);
+
+    wake_time = sample_period_time;
+    timespec_add_nsec(&wake_time, -wake_guard_nsec);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    overshoot = timespec_diff_nsec(&now, &wake_time);
+
+    while (timespec_diff_nsec(&now, &sample_period_time) < 0)
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+    late = timespec_diff_nsec(&now, &sample_period_time);
+    wake_stats_update(late, timespec_diff_nsec(&now, &wake_time) - overshoot,
+                      overshoot);
+    wake_last_late = late;
+
+    if (wake_guard_auto_fl)
+        wake_guard_calibrate(overshoot);
+}
+
+/* Print wake-up jitter and spin CPU cost since last call */
+void wake_stats_print(void)
+{
+    wake_stats_t st = wake_stats;
+
+    wake_stats_reset_req = 1;
+
+    if (!st.count)
+        return;
+
+    printf("wake late min=%ld avg=%ld max=%ld ns, sleep overshoot max=%ld ns,"
+           " guard=%ld ns, spin %ld ns/period (%.1f%% CPU)\n",
+           (long)st.late_min, (long)(st.late_sum / st.count), (long)st.late_max,
+           (long)st.overshoot_max, (long)wake_guard_nsec,
+           (long)(st.spin_sum / st.count),
+           100.0 * st.spin_sum / st.count / sample_period_nsec);
 }
 
 void stop_motor(void)
 {
-    rpi_bidirpwm_set(0);
+    pwm_output_set(0);
 }
 
 void sig_handler(int sig)
@@ -228,17 +687,21 @@ void setup_environment(const char *argv0)
     if (base_task_prio < fifo_min_prio)
         base_task_prio = fifo_min_prio;
 
-    if (rpi_bidirpwm_init() < 0) {
-        fprintf(stderr, "%s: setpwm cannot initialize hardware\n", argv0);
-        fprintf(stderr, "%s: check rpi_hw_types_map in rpi_gpio.c to match /proc/cpuinfo\n", argv0);
-        exit(1);
-    }
+    if (sim_plant_fl) {
+        dc_motor_sim_init(&sim_plant, sample_period_nsec);
+    } else {
+        if (rpi_bidirpwm_init() < 0) {
+            fprintf(stderr, "%s: setpwm cannot initialize hardware\n", argv0);
+            fprintf(stderr, "%s: check rpi_hw_types_map in rpi_gpio.c to match /proc/cpuinfo\n", argv0);
+            exit(1);
+        }
 
-    if (irc_dev_init() < 0) {
-        fprintf(stderr, "%s: readirc device init error\n"
-                        "try: modprobe rpi_gpio_irc_module\n",
-                        argv0);
-        exit(1);
+        if (irc_dev_init() < 0) {
+            fprintf(stderr, "%s: readirc device init error\n"
+                            "try: modprobe rpi_gpio_irc_module\n",
+                            argv0);
+            exit(1);
+        }
     }
 
     if (mlockall(MCL_FUTURE | MCL_CURRENT) < 0) {
@@ -248,78 +711,1204 @@ void setup_environment(const char *argv0)
 
     atexit(stop_motor);
 
+    if (servo_params_shm == NULL) {
+        servo_params_t prm;
+        servo_params_get(&prm);
+        servo_params_shm = servo_params_shm_create(&prm);
+        if (servo_params_shm == NULL)
+            fprintf(stderr, "%s: parameters shared memory cannot be created\n"
+                            "live parameters update is not available\n", argv0);
+        else
+            atexit(servo_params_shm_remove);
+    }
+
     memset(&sigact, 0, sizeof(sigact));
     sigact.sa_handler = sig_handler;
     sigaction(SIGINT, &sigact, NULL);
     sigaction(SIGTERM, &sigact, NULL);
 }
 
-void *speed_controller(void *arg)
+void set_speed(int speed)
 {
-    uint64_t rp_frac;
+    req_speed_fract = speed * (uint64_t)(0x100000000LL / 1000.0 * 2000 / 1000.0);
+}
 
-    do {
-        rp_frac = ref_pos_fract;
-        rp_frac += req_speed_fract;
-        ref_pos_fract = rp_frac;
+/*
+ * Process commands queued by daemon clients and publish
+ * the controller status, called from RT task each period.
+ */
+void servo_ctl_update(void)
+{
+    servo_cmd_t cmd;
+    servo_status_t status;
+    int i;
+
+    if (servo_ctl_shm == NULL)
+        return;
+
+    for (i = 0; i < SERVO_CMDQ_SIZE; i++) {
+        if (!servo_cmdq_pop(servo_ctl_shm, &cmd))
+            break;
+        switch (cmd.code) {
+            case SERVO_CMD_SETSPEED:
+                servo_ref_mode = SERVO_REF_SPEED;
+                set_speed(cmd.arg);
+                break;
+            case SERVO_CMD_SETPOS:
+                servo_ref_mode = SERVO_REF_SPEED;
+                req_speed_fract = 0;
+                ref_pos_fract = (uint64_t)(uint32_t)cmd.arg << 32;
+                break;
+            case SERVO_CMD_STOP:
+                servo_ref_mode = SERVO_REF_SPEED;
+                req_speed_fract = 0;
+                ref_pos_fract = (uint64_t)act_pos << 32;
+                break;
+        }
+        servo_cmds_done++;
+    }
+
+    status.periods = servo_periods;
+    status.cmds_done = servo_cmds_done;
+    status.act_pos = act_pos;
+    status.ref_pos = ref_pos_fract >> 32;
+    status.act_speed = act_speed;
+    status.ctrl_action = ctrl_action;
+    status.ctrl_i_sum = ctrl_i_sum;
+    status.req_speed_fract = req_speed_fract;
+    servo_status_publish(servo_ctl_shm, &status);
+}
 
+static inline void controler_run(uint64_t rp_frac, int vel_loop_fl)
+{
+    if (vel_loop_fl)
+        velocity_controler_step(req_speed_fract);
+    else
         controler_step(rp_frac >> 32);
+}
+
+void speed_controller_step(void)
+{
+    uint64_t rp_frac = ref_pos_fract;
+    int vel_loop_fl = 0;
+    servo_ident_t *id = __atomic_load_n(&servo_ident, __ATOMIC_ACQUIRE);
+
+    servo_params_update();
+    servo_ctl_update();
+    servo_periods++;
+
+    switch (__atomic_load_n(&servo_ref_mode, __ATOMIC_ACQUIRE)) {
+        case SERVO_REF_TRAJ:
+            /* Reference is held (rp_frac unchanged) until the first point arrives */
+            servo_traj_next(servo_traj_shm, &servo_traj_state, &rp_frac);
+            ref_pos_fract = rp_frac;
+            break;
+        case SERVO_REF_MOVE:
+            servo_move_next(&servo_move, &rp_frac);
+            ref_pos_fract = rp_frac;
+            break;
+        case SERVO_REF_VEL:
+            /* Position reference follows estimate for bumpless return */
+            rp_frac = servo_obs.pos_fract;
+            ref_pos_fract = rp_frac;
+            vel_loop_fl = 1;
+            break;
+        default:
+            rp_frac += req_speed_fract;
+            ref_pos_fract = rp_frac;
+            break;
+    }
+
+    if (id != NULL) {
+        if (servo_ident_ref_fl)
+            rp_frac += llrint(ldexp(servo_ident_excite(id), 32));
+        else
+            ctrl_action_inj = lrint(servo_ident_excite(id));
+    }
+
+    ref_vel_fract = (int64_t)(rp_frac - ref_pos_fract_prev);
+    ref_pos_fract_prev = rp_frac;
+
+    if (servo_perf_fl) {
+        servo_perf_begin(&servo_perf);
+        controler_run(rp_frac, vel_loop_fl);
+        servo_perf_end(&servo_perf);
+    } else {
+        controler_run(rp_frac, vel_loop_fl);
+    }
+
+    if (id != NULL)
+        servo_ident_update(id, ctrl_action, (int32_t)act_pos);
+
+    if (servo_scope_fl) {
+        servo_scope_sample_t smp;
+
+        smp.period = servo_periods;
+        smp.ref_pos = rp_frac >> 32;
+        smp.act_pos = act_pos;
+        smp.action = ctrl_action;
+        smp.i_sum = ctrl_i_sum;
+        smp.late = wake_last_late;
+        servo_scope_sample(&servo_scope, &smp);
+    }
+}
+
+/* Counters are per-thread, they are opened by the controller task */
+void servo_perf_setup(void)
+{
+    if (!servo_perf_fl)
+        return;
+
+    if (servo_perf_open(&servo_perf, 1000 * 1000 * 1000 / sample_period_nsec) < 0)
+        fprintf(stderr, "hardware counters are not available\n");
+}
+
+void servo_perf_print(FILE *fout)
+{
+    servo_perf_report_t report;
+    int i;
+
+    if (!servo_perf_fl || (servo_perf_report_read(&servo_perf, &report) < 0))
+        return;
+
+    fprintf(fout, "perf step (%s, %lu steps)", servo_perf.use_rdpmc? "rdpmc": "read",
+            (unsigned long)report.count);
+    for (i = 0; i < servo_perf.nr_cnt; i++)
+        fprintf(fout, " %s min/mean/max %llu/%llu/%llu", servo_perf_names[i],
+                (unsigned long long)report.min[i], (unsigned long long)report.mean[i],
+                (unsigned long long)report.max[i]);
+    fprintf(fout, "\n");
+}
+
+void *speed_controller(void *arg)
+{
+    servo_perf_setup();
+
+    do {
+        speed_controller_step();
+        if (servo_periods == rt_warmup_periods && rt_isolated_launch())
+            rt_warmup_faults = rt_launch_thread_faults() - rt_faults_base;
         wait_next_period();
     } while(1);
 }
 
-void run_speed_controller(int speed)
+/*
+ * Report isolated core setup and verify that controller loop
+ * does not take page faults during warmup periods.
+ */
+void check_rt_warmup(void)
+{
+    int i;
+
+    if (rt_cpu >= 0) {
+        if (rt_sched_deadline_fl) {
+            cpu_set_t cpuset;
+
+            if ((sched_getaffinity(0, sizeof(cpuset), &cpuset) != 0) ||
+                (CPU_COUNT(&cpuset) != 1) || !CPU_ISSET(rt_cpu, &cpuset))
+                fprintf(stderr, "warning: -d does not pin to CPU %d, start in exclusive"
+                                " cpuset partition containing only that CPU\n", rt_cpu);
+        } else if (rt_launch_cpu_in_list(rt_cpu, "/sys/devices/system/cpu/isolated") != 1)
+            fprintf(stderr, "warning: CPU %d is not isolated (isolcpus)\n", rt_cpu);
+        if (rt_launch_cpu_in_list(rt_cpu, "/sys/devices/system/cpu/nohz_full") != 1)
+            fprintf(stderr, "warning: CPU %d is not nohz_full\n", rt_cpu);
+    }
+
+    for (i = 0; rt_warmup_faults < 0; i++) {
+        if (i >= rt_warmup_periods / 10 + 1000) {
+            fprintf(stderr, "warning: controller warmup not finished in time\n");
+            return;
+        }
+        usleep((uint64_t)sample_period_nsec * 10 / 1000);
+    }
+
+    if (rt_warmup_faults)
+        fprintf(stderr, "warning: %ld page faults in first %lu controller periods\n",
+                rt_warmup_faults, (unsigned long)rt_warmup_periods);
+    else
+        printf("no page faults in first %lu controller periods\n",
+               (unsigned long)rt_warmup_periods);
+}
+
+void start_speed_controller(int speed)
 {
     uint32_t pos;
-    int32_t ap;
     pthread_t thread_id;
 
     irc_dev_read(&pos);
     pos_offset = -pos;
 
-    req_speed_fract = speed * (uint64_t)(0x100000000LL / 1000.0 * 2000 / 1000.0);
+    set_speed(speed);
 
     clock_gettime(CLOCK_MONOTONIC, &sample_period_time);
     monitor_period_time = sample_period_time;
 
     ref_pos_fract = 500LL << 32;
+    ref_pos_fract_prev = ref_pos_fract;
+    servo_obs_init(&servo_obs, 0, servo_obs_pos_shift, servo_obs_vel_shift);
 
     if (create_rt_task(&thread_id, base_task_prio, speed_controller, NULL) != 0) {
         fprintf(stderr, "cannot start realtime speed_controller task\n");
         exit(1);
     }
 
+    if (rt_isolated_launch())
+        check_rt_warmup();
+}
+
+/* Observer velocity estimate in counts per second */
+double obs_speed_per_sec(void)
+{
+    return ldexp(servo_obs.vel_fract, -32) * 1e9 / sample_period_nsec;
+}
+
+void run_speed_controller(int speed)
+{
+    int32_t ap;
+
+    start_speed_controller(speed);
+
     do {
         monitor_period_time.tv_sec += 1;
         clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &monitor_period_time, NULL);
         ap = (int32_t)act_pos;
-        printf("ap=%8ld act=%5ld i_sum=%8ld\n", (long)ap, (long)ctrl_action, (long)ctrl_i_sum);
+        printf("ap=%8ld act=%5ld i_sum=%8ld", (long)ap, (long)ctrl_action, (long)ctrl_i_sum);
+        if (servo_obs_d_fl || (servo_ref_mode == SERVO_REF_VEL))
+            printf(" vel=%.1f", obs_speed_per_sec());
+        printf("\n");
+        if (wake_spin_fl)
+            wake_stats_print();
+        servo_perf_print(stdout);
     } while(1);
 }
 
-void print_help(FILE *fout)
+/*
+ * Run speed controller against simulated plant as fast as CPU allows.
+ * Reports controller step cost and following error statistics.
+ */
+void run_sim_speed_controller(int speed, unsigned long periods)
 {
-    fprintf(fout, "Possible commands:\n");
-    fprintf(fout, "  setpwm <value>\n");
-    fprintf(fout, "  readirc\n");
-    fprintf(fout, "  runspeed <value>\n");
-}
+    unsigned long i;
+    struct timespec t0, t1;
+    int64_t step_nsec;
+    int64_t step_nsec_min = INT64_MAX;
+    int64_t step_nsec_max = 0;
+    int64_t step_nsec_sum = 0;
+    int32_t err;
+    int32_t err_max = 0;
+    int32_t action_last = 0;
+    int64_t action_ripple = 0;
+    int monitor_periods = 1000 * 1000 * 1000 / sample_period_nsec;
 
-int main(int argc, char *argv[])
+    sim_plant_fl = 1;
+    sim_lockstep_fl = 1;
+    dc_motor_sim_init(&sim_plant, sample_period_nsec);
+
+    pos_offset = 0;
+    act_pos = 0;
+    ref_pos_fract = 0;
+    ref_pos_fract_prev = 0;
+    servo_obs_init(&servo_obs, 0, servo_obs_pos_shift, servo_obs_vel_shift);
+    set_speed(speed);
+
+    servo_perf_setup();
+
+    for (i = 0; i < periods; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        speed_controller_step();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        step_nsec = timespec_diff_nsec(&t1, &t0);
+        step_nsec_sum += step_nsec;
+        if (step_nsec < step_nsec_min)
+            step_nsec_min = step_nsec;
+        if (step_nsec > step_nsec_max)
+            step_nsec_max = step_nsec;
+
+        err = (int32_t)((uint32_t)(ref_pos_fract >> 32) - act_pos);
+        if (err < 0)
+            err = -err;
+        if (err > err_max)
+            err_max = err;
+
+        /* Action noise, quantization amplified by the difference component */
+        action_ripple += abs(ctrl_action - action_last);
+        action_last = ctrl_action;
+
+        if ((i + 1) % monitor_periods == 0)
+            printf("ap=%8ld act=%5ld i_sum=%8ld\n", (long)(int32_t)act_pos,
+                   (long)ctrl_action, (long)ctrl_i_sum);
+
+        wait_next_period();
+    }
+
+    if (!periods)
+        return;
+
+    printf("periods %lu, step nsec min %lld avg %lld max %lld\n", periods,
+           (long long)step_nsec_min, (long long)(step_nsec_sum / periods),
+           (long long)step_nsec_max);
+    printf("final ap=%ld rp=%ld err_max=%ld vel=%.1f\n", (long)(int32_t)act_pos,
+           (long)(int32_t)(ref_pos_fract >> 32), (long)err_max, obs_speed_per_sec());
+    printf("action ripple avg %.2f per period\n", (double)action_ripple / periods);
+
+    if (servo_scope_fl) {
+        servo_scope_sync(&servo_scope);
+        printf("scope captures %lu, missed triggers %lu\n",
+               (unsigned long)servo_scope.captures, (unsigned long)servo_scope.missed);
+    }
+    servo_perf_print(stdout);
+}
+
+int set_params(const char *argv0, int argc, char *argv[])
+{
+    servo_params_shm_t *shm;
+    servo_params_t prm;
+    uint32_t version;
+    char *p;
+    long value;
+    int i;
+    int retry;
+
+    shm = servo_params_shm_attach();
+    if (shm == NULL) {
+        fprintf(stderr, "%s: setparams no running controller found\n", argv0);
+        return -1;
+    }
+
+    servo_params_read(shm, &prm);
+    prm.flags = 0;
+
+    for (i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "bumpless")) {
+            prm.flags |= SERVO_PARAMS_BUMPLESS;
+            continue;
+        }
+        p = strchr(argv[i], '=');
+        if (p == NULL) {
+            fprintf(stderr, "%s: setparams %s is not name=value\n", argv0, argv[i]);
+            return -1;
+        }
+        value = strtol(p + 1, &p, 0);
+        if (*p) {
+            fprintf(stderr, "%s: setparams %s value parse error\n", argv0, argv[i]);
+            return -1;
+        }
+        if (!strncmp(argv[i], "p=", 2)) {
+            prm.ctrl_p = value;
+        } else if (!strncmp(argv[i], "i=", 2)) {
+            prm.ctrl_i = value;
+        } else if (!strncmp(argv[i], "d=", 2)) {
+            prm.ctrl_d = value;
+        } else if (!strncmp(argv[i], "pwm_max=", 8)) {
+            if ((value < 0) || (value > 4000)) {
+                fprintf(stderr, "%s: setparams pwm_max out of range 0..4000\n", argv0);
+                return -1;
+            }
+            prm.pwm_max = value;
+        } else if (!strncmp(argv[i], "period=", 7)) {
+            if (value != (long)prm.sample_period_nsec) {
+                fprintf(stderr, "%s: setparams period can be changed only by controller restart\n", argv0);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "%s: setparams unknown parameter %s\n", argv0, argv[i]);
+            return -1;
+        }
+    }
+
+    version = servo_params_publish(shm, &prm);
+
+    /* Wait up to one second for controller to confirm the swap */
+    for (retry = 0; retry < 100; retry++) {
+        if ((int32_t)(__atomic_load_n(&shm->applied_version, __ATOMIC_ACQUIRE) -
+            version) >= 0)
+            break;
+        usleep(10000);
+    }
+
+    printf("p=%ld i=%ld d=%ld pwm_max=%lu period=%lu %s\n",
+           (long)prm.ctrl_p, (long)prm.ctrl_i, (long)prm.ctrl_d,
+           (unsigned long)prm.pwm_max, (unsigned long)prm.sample_period_nsec,
+           retry < 100? "applied": "not confirmed by controller");
+
+    servo_params_shm_release(shm);
+
+    return retry < 100? 0: -1;
+}
+
+/*
+ * Parse one control request line and queue it to RT task.
+ * The reply is written to the provided buffer.
+ */
+void servo_ctl_request(char *line, char *reply, size_t reply_size)
+{
+    servo_cmd_t cmd;
+    servo_status_t status;
+    char *name;
+    char *arg;
+    char *p;
+
+    name = strtok_r(line, " \t\r\n", &p);
+    arg = strtok_r(NULL, " \t\r\n", &p);
+
+    if (name == NULL) {
+        snprintf(reply, reply_size, "err empty request\n");
+        return;
+    }
+
+    if (!strcmp(name, "stats")) {
+        if (servo_status_read(servo_ctl_shm, &status) < 0) {
+            snprintf(reply, reply_size, "err status not available\n");
+            return;
+        }
+        snprintf(reply, reply_size,
+                 "ok periods=%lu cmds=%lu ap=%ld rp=%ld speed=%ld act=%ld i_sum=%ld\n",
+                 (unsigned long)status.periods, (unsigned long)status.cmds_done,
+                 (long)status.act_pos, (long)status.ref_pos,
+                 (long)status.act_speed, (long)status.ctrl_action,
+                 (long)status.ctrl_i_sum);
+        if (servo_perf_fl) {
+            size_t len = strlen(reply);
+            FILE *f = fmemopen(reply + len, reply_size - len, "w");
+            if (f != NULL) {
+                servo_perf_print(f);
+                fclose(f);
+            }
+        }
+        return;
+    }
+
+    cmd.arg = 0;
+    if (!strcmp(name, "setspeed")) {
+        cmd.code = SERVO_CMD_SETSPEED;
+    } else if (!strcmp(name, "setpos")) {
+        cmd.code = SERVO_CMD_SETPOS;
+    } else if (!strcmp(name, "stop")) {
+        cmd.code = SERVO_CMD_STOP;
+    } else {
+        snprintf(reply, reply_size, "err unknown command %s\n", name);
+        return;
+    }
+
+    if (cmd.code != SERVO_CMD_STOP) {
+        if (arg == NULL) {
+            snprintf(reply, reply_size, "err %s requires argument\n", name);
+            return;
+        }
+        cmd.arg = strtol(arg, &p, 0);
+        if ((arg == p) || *p) {
+            snprintf(reply, reply_size, "err %s value parse error\n", name);
+            return;
+        }
+    }
+
+    if (servo_cmdq_push(servo_ctl_shm, &cmd) < 0) {
+        snprintf(reply, reply_size, "err command queue full\n");
+        return;
+    }
+
+    snprintf(reply, reply_size, "ok\n");
+}
+
+/*
+ * Long-lived controller. RT task only polls the commands mailbox,
+ * the socket endpoint is served by the main (non-RT) thread.
+ */
+void run_servo_daemon(const char *argv0, const char *sock_path)
+{
+    struct sockaddr_un addr;
+    int listen_fd;
+    int fd;
+    FILE *fin;
+    char line[256];
+    char reply[256];
+
+    servo_ctl_shm = servo_ctl_shm_create();
+    if (servo_ctl_shm == NULL) {
+        fprintf(stderr, "%s: commands shared memory cannot be created\n", argv0);
+        exit(1);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        perror("socket");
+        exit(1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+    unlink(addr.sun_path);
+
+    if ((bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) ||
+        (listen(listen_fd, 4) == -1)) {
+        fprintf(stderr, "%s: cannot listen on %s\n", argv0, addr.sun_path);
+        exit(1);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    start_speed_controller(0);
+
+    do {
+        fd = accept(listen_fd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            exit(1);
+        }
+        fin = fdopen(fd, "r");
+        if (fin == NULL) {
+            close(fd);
+            continue;
+        }
+        while (fgets(line, sizeof(line), fin) != NULL) {
+            servo_ctl_request(line, reply, sizeof(reply));
+            if (write(fd, reply, strlen(reply)) < 0)
+                break;
+        }
+        fclose(fin);
+    } while(1);
+}
+
+int servo_ctl_client(const char *argv0, const char *sock_path, int argc, char *argv[])
+{
+    struct sockaddr_un addr;
+    char buf[256];
+    size_t len = 0;
+    ssize_t ret;
+    int fd;
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        ret = snprintf(buf + len, sizeof(buf) - len, "%s%s", i? " ": "", argv[i]);
+        if (ret >= sizeof(buf) - len - 1) {
+            fprintf(stderr, "%s: ctl request too long\n", argv0);
+            return -1;
+        }
+        len += ret;
+    }
+    buf[len++] = '\n';
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "%s: cannot connect to daemon at %s\n", argv0, addr.sun_path);
+        close(fd);
+        return -1;
+    }
+
+    if (write(fd, buf, len) != len) {
+        close(fd);
+        return -1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    while ((ret = read(fd, buf, sizeof(buf))) > 0)
+        fwrite(buf, 1, ret, stdout);
+
+    close(fd);
+
+    return 0;
+}
+
+/*
+ * Feed trajectory points from file or pipe to the RT task.
+ * Each line holds position and optional velocity setpoint.
+ */
+int run_trajectory(const char *argv0, const char *file_name, uint32_t point_periods)
+{
+    FILE *f;
+    char line[256];
+    char *p;
+    servo_traj_point_t pt;
+    long value;
+    unsigned long points = 0;
+    unsigned long line_nr = 0;
+
+    if (!strcmp(file_name, "-")) {
+        f = stdin;
+    } else {
+        f = fopen(file_name, "r");
+        if (f == NULL) {
+            fprintf(stderr, "%s: cannot open %s\n", argv0, file_name);
+            return -1;
+        }
+    }
+
+    servo_traj_shm = servo_traj_shm_create(point_periods);
+    if (servo_traj_shm == NULL) {
+        fprintf(stderr, "%s: trajectory shared memory cannot be created\n", argv0);
+        return -1;
+    }
+
+    memset(&servo_traj_state, 0, sizeof(servo_traj_state));
+    servo_ref_mode = SERVO_REF_TRAJ;
+    start_speed_controller(0);
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_nr++;
+        p = line + strspn(line, " \t");
+        if ((*p == '#') || (*p == '\n') || !*p)
+            continue;
+        errno = 0;
+        value = strtol(p, &p, 0);
+        p += strspn(p, " \t\r\n");
+        if (errno || *p || (value < INT32_MIN) || (value > INT32_MAX)) {
+            fprintf(stderr, "%s: trajectory parse error at line %lu\n", argv0, line_nr);
+            return -1;
+        }
+        pt.pos = value;
+        if (servo_traj_push(servo_traj_shm, &pt) < 0) {
+            fprintf(stderr, "%s: trajectory push failed at line %lu\n", argv0, line_nr);
+            return -1;
+        }
+        points++;
+    }
+    servo_traj_finish(servo_traj_shm);
+
+    if (f != stdin)
+        fclose(f);
+
+    while (!servo_traj_done(servo_traj_shm))
+        usleep(10000);
+
+    /* Let the last interpolation segment finish and the axis settle */
+    sleep(1);
+
+    printf("points %lu, underruns %lu (%lu periods), ap=%ld rp=%ld\n", points,
+           (unsigned long)servo_traj_shm->underruns,
+           (unsigned long)servo_traj_shm->underrun_periods,
+           (long)(int32_t)act_pos, (long)(int32_t)(ref_pos_fract >> 32));
+
+    return 0;
+}
+
+/*
+ * Move from actual reference position to the target with
+ * jerk-limited profile. The plan is computed here and handed
+ * over to the RT task by switch of the reference mode.
+ */
+int run_move(const char *argv0, int32_t target, double vmax, double amax, double jmax)
+{
+    servo_move_t *mv = &servo_move;
+    int32_t ap;
+
+    start_speed_controller(0);
+
+    /* Speed is zero, reference position is stable now */
+    if (servo_move_plan(mv, ref_pos_fract, target, vmax, amax, jmax,
+                        sample_period_nsec * 1e-9) < 0) {
+        fprintf(stderr, "%s: runpos invalid limits\n", argv0);
+        return -1;
+    }
+    __atomic_store_n(&servo_ref_mode, SERVO_REF_MOVE, __ATOMIC_RELEASE);
+
+    do {
+        monitor_period_time.tv_sec += 1;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &monitor_period_time, NULL);
+        ap = (int32_t)act_pos;
+        printf("ap=%8ld act=%5ld i_sum=%8ld\n", (long)ap, (long)ctrl_action, (long)ctrl_i_sum);
+    } while (!__atomic_load_n(&mv->done, __ATOMIC_ACQUIRE));
+
+    printf("move done, ap=%ld rp=%ld\n", (long)(int32_t)act_pos,
+           (long)(int32_t)(ref_pos_fract >> 32));
+
+    return 0;
+}
+
+/* Measure per-sample cost of the move generator, no hardware needed */
+int bench_move(const char *argv0, int32_t target, double vmax, double amax, double jmax)
+{
+    servo_move_t mv;
+    uint64_t rp = 0;
+    uint64_t rp_last = 0;
+    unsigned long samples = 0;
+    unsigned long runs = 0;
+    struct timespec t0, t1;
+    double period = sample_period_nsec * 1e-9;
+    double vel_max = 0;
+    double acc_max = 0;
+    double residual;
+
+    if (servo_move_plan(&mv, 0, target, vmax, amax, jmax, period) < 0) {
+        fprintf(stderr, "%s: benchmove invalid limits\n", argv0);
+        return -1;
+    }
+    while (servo_move_next(&mv, &rp)) {
+        if (fabs(ldexp(mv.vel, -SERVO_MOVE_FRACT_BITS)) > vel_max)
+            vel_max = fabs(ldexp(mv.vel, -SERVO_MOVE_FRACT_BITS));
+        if (fabs(ldexp(mv.acc, -SERVO_MOVE_FRACT_BITS)) > acc_max)
+            acc_max = fabs(ldexp(mv.acc, -SERVO_MOVE_FRACT_BITS));
+        rp_last = rp;
+        samples++;
+    }
+    residual = ldexp((int64_t)(rp - rp_last), -32);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        servo_move_plan(&mv, 0, target, vmax, amax, jmax, period);
+        while (servo_move_next(&mv, &rp))
+            ;
+        runs++;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+    } while (timespec_diff_nsec(&t1, &t0) < 1000000000);
+
+    printf("samples %lu (%.3f s), peak vel %.1f counts/s, peak acc %.1f counts/s^2\n",
+           samples, samples * period, vel_max / period, acc_max / period / period);
+    printf("final snap %.6f counts\n", residual);
+    printf("%lu runs, %.2f ns per sample including planning\n", runs,
+           (double)timespec_diff_nsec(&t1, &t0) / runs / (samples? samples: 1));
+
+    mv.pos_fract = 0;
+    servo_move_plan(&mv, 0, target, vmax, amax, jmax, period);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (servo_move_next(&mv, &rp))
+        ;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("single run %.2f ns per sample\n",
+           (double)timespec_diff_nsec(&t1, &t0) / (samples? samples: 1));
+
+    return 0;
+}
+
+static void ident_print_ratio(FILE *fout, const servo_ident_t *id, int idx,
+                              int num, int den, double *phase_last)
+{
+    double mag, phase;
+
+    servo_ident_ratio(id, idx, num, den, &mag, &phase);
+    /* Unwrap to be continuous with the previous frequency */
+    if (idx > 0) {
+        while (phase - *phase_last > 180)
+            phase -= 360;
+        while (phase - *phase_last < -180)
+            phase += 360;
+    }
+    *phase_last = phase;
+
+    fprintf(fout, " %9.3f %8.2f", mag > 0? 20 * log10(mag): -999.0, phase);
+}
+
+/*
+ * Measure frequency response around position loop holding
+ * actual position. Excitation is added to the action (PWM units)
+ * or to the position reference (IRC counts). With simulated plant
+ * the loop runs in lockstep as fast as possible.
+ */
+int run_ident(const char *argv0, int ref_fl, double amplitude, double fmin,
+              double fmax, int n_freq, const char *out_file)
+{
+    static servo_ident_t id;
+    double period = sample_period_nsec * 1e-9;
+    double total = 0;
+    double phase[3];
+    FILE *fout = stdout;
+    int i;
+
+    if (servo_ident_plan(&id, amplitude, fmin, fmax, n_freq, period) < 0) {
+        fprintf(stderr, "%s: ident invalid frequency range or amplitude\n", argv0);
+        return -1;
+    }
+    for (i = 0; i < n_freq; i++)
+        total += (id.settle[i] + id.measure[i]) * period;
+    fprintf(stderr, "%s: ident %d frequencies %.3f to %.3f Hz, %.1f s\n", argv0,
+            n_freq, id.freq[0], id.freq[n_freq - 1], total);
+
+    if (out_file != NULL) {
+        fout = fopen(out_file, "w");
+        if (fout == NULL) {
+            fprintf(stderr, "%s: cannot open %s: %s\n", argv0, out_file, strerror(errno));
+            return -1;
+        }
+    }
+
+    servo_ident_ref_fl = ref_fl;
+
+    if (sim_plant_fl) {
+        sim_lockstep_fl = 1;
+        dc_motor_sim_init(&sim_plant, sample_period_nsec);
+        pos_offset = 0;
+        act_pos = 0;
+        ref_pos_fract = 0;
+        ref_pos_fract_prev = 0;
+        req_speed_fract = 0;
+        servo_obs_init(&servo_obs, 0, servo_obs_pos_shift, servo_obs_vel_shift);
+
+        __atomic_store_n(&servo_ident, &id, __ATOMIC_RELEASE);
+        while (!id.done) {
+            speed_controller_step();
+            wait_next_period();
+        }
+    } else {
+        setup_environment(argv0);
+        start_speed_controller(0);
+
+        /* Let the position loop settle before excitation */
+        monitor_period_time.tv_sec += 1;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &monitor_period_time, NULL);
+
+        __atomic_store_n(&servo_ident, &id, __ATOMIC_RELEASE);
+        while (!__atomic_load_n(&id.done, __ATOMIC_ACQUIRE)) {
+            monitor_period_time.tv_sec += 1;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &monitor_period_time, NULL);
+            fprintf(stderr, "ident %d/%d %.3f Hz ap=%ld act=%ld\n", id.idx + 1, n_freq,
+                    id.freq[id.idx], (long)(int32_t)act_pos, (long)ctrl_action);
+        }
+    }
+
+    __atomic_store_n(&servo_ident, NULL, __ATOMIC_RELEASE);
+    ctrl_action_inj = 0;
+
+    fprintf(fout, "# excitation %s amplitude %g\n", ref_fl? "reference": "action", amplitude);
+    fprintf(fout, "# freq_hz   pos/act_db  deg   pos/exc_db  deg   act/exc_db  deg\n");
+    for (i = 0; i < n_freq; i++) {
+        fprintf(fout, "%10.4f", id.freq[i]);
+        ident_print_ratio(fout, &id, i, SERVO_IDENT_POS, SERVO_IDENT_ACT, &phase[0]);
+        ident_print_ratio(fout, &id, i, SERVO_IDENT_POS, SERVO_IDENT_EXC, &phase[1]);
+        ident_print_ratio(fout, &id, i, SERVO_IDENT_ACT, SERVO_IDENT_EXC, &phase[2]);
+        fprintf(fout, "\n");
+    }
+
+    if (fout != stdout)
+        fclose(fout);
+
+    return 0;
+}
+
+#define LATENCY_HIST_BINS 1000  /* 1 usec bins */
+
+uint32_t latency_hist[LATENCY_HIST_BINS];
+uint32_t latency_hist_overflow;
+uint32_t latency_samples;
+int32_t latency_min = INT32_MAX;
+int32_t latency_max;
+int64_t latency_sum;
+int32_t latency_io_max;
+int64_t latency_io_sum;
+volatile int latency_run_fl;
+
+/*
+ * Measure wake-up latency of exactly the same task setup
+ * as the controller uses, including sensor read and PWM
+ * register write each period.
+ */
+void *latency_task(void *arg)
+{
+    uint32_t pos;
+    uint32_t bin;
+    int32_t io_nsec;
+    struct timespec t0, t1;
+
+    while (latency_run_fl) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        irc_dev_read(&pos);
+        pwm_output_set(0);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        io_nsec = timespec_diff_nsec(&t1, &t0);
+        latency_io_sum += io_nsec;
+        if (io_nsec > latency_io_max)
+            latency_io_max = io_nsec;
+
+        wait_next_period();
+
+        latency_samples++;
+        latency_sum += wake_last_late;
+        if (wake_last_late < latency_min)
+            latency_min = wake_last_late;
+        if (wake_last_late > latency_max)
+            latency_max = wake_last_late;
+        bin = wake_last_late < 0? 0: wake_last_late / 1000;
+        if (bin < LATENCY_HIST_BINS)
+            latency_hist[bin]++;
+        else
+            latency_hist_overflow++;
+    }
+
+    return NULL;
+}
+
+int run_latency_test(const char *argv0, long duration, const char *hist_file)
+{
+    pthread_t thread_id;
+    FILE *f;
+    int i;
+    int last_bin = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &sample_period_time);
+    monitor_period_time = sample_period_time;
+
+    latency_run_fl = 1;
+    if (create_rt_task(&thread_id, base_task_prio, latency_task, NULL) != 0) {
+        fprintf(stderr, "%s: cannot start realtime latency task\n", argv0);
+        return -1;
+    }
+
+    for (i = 0; i < duration; i++) {
+        monitor_period_time.tv_sec += 1;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &monitor_period_time, NULL);
+        wake_stats_print();
+    }
+
+    latency_run_fl = 0;
+    pthread_join(thread_id, NULL);
+
+    if (!latency_samples)
+        return -1;
+
+    for (i = 0; i < LATENCY_HIST_BINS; i++)
+        if (latency_hist[i])
+            last_bin = i;
+
+    if (hist_file != NULL) {
+        f = fopen(hist_file, "w");
+        if (f == NULL) {
+            fprintf(stderr, "%s: cannot open %s\n", argv0, hist_file);
+            return -1;
+        }
+        fprintf(f, "# rpi_simple_dc_servo latency histogram, %s I/O\n",
+                sim_plant_fl? "simulated": "hardware");
+        fprintf(f, "# period %lu ns, bin 1 us\n", (unsigned long)sample_period_nsec);
+        for (i = 0; i <= last_bin; i++)
+            fprintf(f, "%06d %06lu\n", i, (unsigned long)latency_hist[i]);
+        fprintf(f, "# Total: %09lu\n", (unsigned long)latency_samples);
+        fprintf(f, "# Min Latencies: %05ld\n", (long)latency_min / 1000);
+        fprintf(f, "# Avg Latencies: %05ld\n", (long)(latency_sum / latency_samples / 1000));
+        fprintf(f, "# Max Latencies: %05ld\n", (long)latency_max / 1000);
+        fprintf(f, "# Histogram Overflows: %05lu\n", (unsigned long)latency_hist_overflow);
+        fclose(f);
+    }
+
+    printf("samples %lu, latency min %ld avg %ld max %ld ns, overflows %lu\n",
+           (unsigned long)latency_samples, (long)latency_min,
+           (long)(latency_sum / latency_samples), (long)latency_max,
+           (unsigned long)latency_hist_overflow);
+    printf("sensor and actuator access avg %ld max %ld ns\n",
+           (long)(latency_io_sum / latency_samples), (long)latency_io_max);
+
+    return 0;
+}
+
+/*
+ * Scope options in form err=<counts>,sat,late[=<ns>],pre=<n>,
+ * post=<n>,file=<prefix>,count=<n>
+ */
+int servo_scope_setup(const char *argv0, char *opts)
+{
+    enum {
+        SCOPE_ERR = 0,
+        SCOPE_SAT,
+        SCOPE_LATE,
+        SCOPE_PRE,
+        SCOPE_POST,
+        SCOPE_FILE,
+        SCOPE_COUNT,
+    };
+    char *const tokens[] = {
+        [SCOPE_ERR] = "err",
+        [SCOPE_SAT] = "sat",
+        [SCOPE_LATE] = "late",
+        [SCOPE_PRE] = "pre",
+        [SCOPE_POST] = "post",
+        [SCOPE_FILE] = "file",
+        [SCOPE_COUNT] = "count",
+        NULL
+    };
+    servo_scope_t *sc = &servo_scope;
+    unsigned long pre = 1000;
+    unsigned long post = 1000;
+    char *value;
+    char *p;
+    int tok;
+
+    sc->file_prefix = "/tmp/rpi_simple_dc_servo_scope";
+    sc->late_limit = sample_period_nsec / 2;
+
+    while (*opts != '\0') {
+        tok = getsubopt(&opts, tokens, &value);
+        if ((tok == SCOPE_SAT) || ((tok == SCOPE_LATE) && (value == NULL))) {
+            sc->trig_mask |= tok == SCOPE_SAT? SERVO_SCOPE_TRIG_SAT: SERVO_SCOPE_TRIG_LATE;
+            continue;
+        }
+        if ((tok < 0) || (value == NULL)) {
+            fprintf(stderr, "%s: -t unknown or incomplete scope option\n", argv0);
+            return -1;
+        }
+        if (tok == SCOPE_FILE) {
+            sc->file_prefix = value;
+            continue;
+        }
+        errno = 0;
+        switch (tok) {
+            case SCOPE_ERR:
+                sc->err_limit = strtol(value, &p, 0);
+                sc->trig_mask |= SERVO_SCOPE_TRIG_ERR;
+                break;
+            case SCOPE_LATE:
+                sc->late_limit = strtol(value, &p, 0);
+                sc->trig_mask |= SERVO_SCOPE_TRIG_LATE;
+                break;
+            case SCOPE_PRE:
+                pre = strtoul(value, &p, 0);
+                break;
+            case SCOPE_POST:
+                post = strtoul(value, &p, 0);
+                break;
+            case SCOPE_COUNT:
+                sc->max_captures = strtoul(value, &p, 0);
+                break;
+        }
+        if ((value == p) || errno) {
+            fprintf(stderr, "%s: -t scope option value parse error\n", argv0);
+            return -1;
+        }
+    }
+
+    if (!sc->trig_mask) {
+        fprintf(stderr, "%s: -t requires at least one of err, sat or late trigger\n", argv0);
+        return -1;
+    }
+
+    if (servo_scope_init(sc, pre, post) < 0) {
+        fprintf(stderr, "%s: -t pre and post samples exceed %d\n", argv0,
+                SERVO_SCOPE_LEN - 1);
+        return -1;
+    }
+
+    servo_scope_fl = 1;
+
+    return 0;
+}
+
+void print_help(FILE *fout)
+{
+    fprintf(fout, "Options:\n");
+    fprintf(fout, "  -d           run controller under SCHED_DEADLINE\n");
+    fprintf(fout, "  -r <pct>     SCHED_DEADLINE runtime in percent of period\n");
+    fprintf(fout, "  -c <cpu>     pin controller to (isolated) CPU, with -d the CPU has to be\n");
+    fprintf(fout, "               the only one of exclusive cpuset partition the program runs in\n");
+    fprintf(fout, "  -g <ns|auto> sleep until deadline minus guard band then spin\n");
+    fprintf(fout, "  -p           hardware counters statistics of control step\n");
+    fprintf(fout, "  -s           simulated plant instead of hardware (dry-run)\n");
+    fprintf(fout, "  -o           difference component from velocity observer\n");
+    fprintf(fout, "  -S <socket>  control socket of daemon and ctl\n");
+    fprintf(fout, "  -t <opts>    triggered scope capture, comma separated options\n");
+    fprintf(fout, "               err=<counts>,sat,late[=<ns>],pre=<n>,post=<n>,file=<prefix>,count=<n>\n");
+    fprintf(fout, "Possible commands:\n");
+    fprintf(fout, "  setpwm <value>\n");
+    fprintf(fout, "  readirc\n");
+    fprintf(fout, "  runspeed <value>\n");
+    fprintf(fout, "  runvel <value>\n");
+    fprintf(fout, "  simspeed <value> [periods]\n");
+    fprintf(fout, "  simvel <value> [periods]\n");
+    fprintf(fout, "  runpos <target> <vmax> <amax> [jmax]\n");
+    fprintf(fout, "  benchmove <target> <vmax> <amax> [jmax]\n");
+    fprintf(fout, "  runtraj <file|-> [periods_per_point]\n");
+    fprintf(fout, "               one position [IRC counts] per line, linearly interpolated\n");
+    fprintf(fout, "  ident act|ref <amplitude> <fmin> <fmax> [points] [file]\n");
+    fprintf(fout, "  latency <seconds> [histogram_file]\n");
+    fprintf(fout, "  daemon [socket]\n");
+    fprintf(fout, "  ctl setspeed|setpos|stop|stats [value]\n");
+    fprintf(fout, "  setparams [p=<v>] [i=<v>] [d=<v>] [pwm_max=<v>] [bumpless]\n");
+}
+
+int main(int argc, char *argv[])
 {
     long value;
     char *p;
+    char *argv0 = argv[0];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+dr:c:g:psoS:t:")) != -1) {
+        switch (opt) {
+            case 'd':
+                rt_sched_deadline_fl = 1;
+                break;
+            case 'r':
+                rt_deadline_runtime_pct = strtol(optarg, &p, 0);
+                if ((optarg == p) || (rt_deadline_runtime_pct <= 0) ||
+                    (rt_deadline_runtime_pct > 100)) {
+                    fprintf(stderr, "%s: -r runtime percent parse error\n", argv0);
+                    exit(1);
+                }
+                break;
+            case 'c':
+                rt_cpu = strtol(optarg, &p, 0);
+                if ((optarg == p) || (rt_cpu < 0) || (rt_cpu >= CPU_SETSIZE)) {
+                    fprintf(stderr, "%s: -c cpu number parse error\n", argv0);
+                    exit(1);
+                }
+                break;
+            case 'g':
+                wake_spin_fl = 1;
+                if (!strcmp(optarg, "auto")) {
+                    wake_guard_auto_fl = 1;
+                    wake_guard_nsec = 50000;
+                    break;
+                }
+                wake_guard_nsec = strtol(optarg, &p, 0);
+                if ((optarg == p) || (wake_guard_nsec < 0)) {
+                    fprintf(stderr, "%s: -g guard band parse error\n", argv0);
+                    exit(1);
+                }
+                break;
+            case 's':
+                sim_plant_fl = 1;
+                break;
+            case 'p':
+                servo_perf_fl = 1;
+                break;
+            case 'o':
+                servo_obs_d_fl = 1;
+                break;
+            case 'S':
+                ctl_socket_path = optarg;
+                break;
+            case 't':
+                if (servo_scope_setup(argv0, optarg) < 0)
+                    exit(1);
+                break;
+            default:
+                print_help(stderr);
+                exit(1);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+    argv[0] = argv0;
+
+    if (wake_spin_fl && (wake_guard_limit_setup(argv0) < 0))
+        exit(1);
+
+    if (servo_scope_fl) {
+        servo_scope.act_limit = pwm_max;
+        if (servo_scope_start(&servo_scope) < 0) {
+            fprintf(stderr, "%s: cannot start scope writer\n", argv0);
+            exit(1);
+        }
+    }
 
     if (argc < 2) {
         fprintf(stderr, "%s: at least one argument (command) has to be specified\n"
-                        "Usage: %s <command> [argument]\n",
+                        "Usage: %s [options] <command> [argument]\n",
                     argv[0], argv[0]);
         print_help(stderr);
         exit(1);
     }
 
     if (!strcmp(argv[1], "help")) {
-        fprintf(stdout, "Usage: %s <command> [argument]\n", argv[0]);
+        fprintf(stdout, "Usage: %s [options] <command> [argument]\n", argv[0]);
         print_help(stdout);
         return 0;
     } else if (!strcmp(argv[1], "setpwm")) {
@@ -365,9 +1954,147 @@ int main(int argc, char *argv[])
             exit(1);
         }
         run_speed_controller(value);
+    } else if (!strcmp(argv[1], "runvel")) {
+        if (argc < 3) {
+            fprintf(stderr, "%s: runvel requires argument\n", argv[0]);
+            exit(1);
+        }
+        setup_environment(argv[0]);
+
+        value = strtol(argv[2], &p, 0);
+        if (argv[2] == p) {
+            fprintf(stderr, "%s: runvel value parse error\n", argv[0]);
+            exit(1);
+        }
+        servo_ref_mode = SERVO_REF_VEL;
+        run_speed_controller(value);
+    } else if (!strcmp(argv[1], "simspeed") || !strcmp(argv[1], "simvel")) {
+        unsigned long periods = 10000;
+        if (argc < 3) {
+            fprintf(stderr, "%s: %s requires argument\n", argv[0], argv[1]);
+            exit(1);
+        }
+        value = strtol(argv[2], &p, 0);
+        if (argv[2] == p) {
+            fprintf(stderr, "%s: %s value parse error\n", argv[0], argv[1]);
+            exit(1);
+        }
+        if (argc >= 4) {
+            periods = strtoul(argv[3], &p, 0);
+            if (argv[3] == p) {
+                fprintf(stderr, "%s: %s periods parse error\n", argv[0], argv[1]);
+                exit(1);
+            }
+        }
+        if (!strcmp(argv[1], "simvel"))
+            servo_ref_mode = SERVO_REF_VEL;
+        run_sim_speed_controller(value, periods);
+    } else if (!strcmp(argv[1], "runpos") || !strcmp(argv[1], "benchmove")) {
+        double lim[3] = {0, 0, 0};
+        int i;
+        if (argc < 5) {
+            fprintf(stderr, "%s: %s requires target, vmax and amax\n", argv[0], argv[1]);
+            exit(1);
+        }
+        value = strtol(argv[2], &p, 0);
+        if (argv[2] == p) {
+            fprintf(stderr, "%s: %s target parse error\n", argv[0], argv[1]);
+            exit(1);
+        }
+        for (i = 0; (i < 3) && (i + 3 < argc); i++) {
+            lim[i] = strtod(argv[i + 3], &p);
+            if (argv[i + 3] == p) {
+                fprintf(stderr, "%s: %s limit parse error\n", argv[0], argv[1]);
+                exit(1);
+            }
+        }
+        if (!strcmp(argv[1], "benchmove")) {
+            if (bench_move(argv[0], value, lim[0], lim[1], lim[2]) < 0)
+                exit(1);
+        } else {
+            setup_environment(argv[0]);
+            if (run_move(argv[0], value, lim[0], lim[1], lim[2]) < 0)
+                exit(1);
+        }
+    } else if (!strcmp(argv[1], "ident")) {
+        double lim[3];
+        int n_freq = 20;
+        int ref_fl;
+        int i;
+        if (argc < 6) {
+            fprintf(stderr, "%s: ident requires injection, amplitude, fmin and fmax\n", argv[0]);
+            exit(1);
+        }
+        if (!strcmp(argv[2], "ref")) {
+            ref_fl = 1;
+        } else if (!strcmp(argv[2], "act")) {
+            ref_fl = 0;
+        } else {
+            fprintf(stderr, "%s: ident injection has to be act or ref\n", argv[0]);
+            exit(1);
+        }
+        for (i = 0; i < 3; i++) {
+            lim[i] = strtod(argv[i + 3], &p);
+            if (argv[i + 3] == p) {
+                fprintf(stderr, "%s: ident parameter parse error\n", argv[0]);
+                exit(1);
+            }
+        }
+        if (argc >= 7) {
+            n_freq = strtol(argv[6], &p, 0);
+            if (argv[6] == p) {
+                fprintf(stderr, "%s: ident points parse error\n", argv[0]);
+                exit(1);
+            }
+        }
+        if (run_ident(argv[0], ref_fl, lim[0], lim[1], lim[2], n_freq,
+                      argc >= 8? argv[7]: NULL) < 0)
+            exit(1);
+    } else if (!strcmp(argv[1], "runtraj")) {
+        unsigned long point_periods = 1;
+        if (argc < 3) {
+            fprintf(stderr, "%s: runtraj requires file argument\n", argv[0]);
+            exit(1);
+        }
+        if (argc >= 4) {
+            point_periods = strtoul(argv[3], &p, 0);
+            if ((argv[3] == p) || !point_periods) {
+                fprintf(stderr, "%s: runtraj periods per point parse error\n", argv[0]);
+                exit(1);
+            }
+        }
+        setup_environment(argv[0]);
+        if (run_trajectory(argv[0], argv[2], point_periods) < 0)
+            exit(1);
+    } else if (!strcmp(argv[1], "latency")) {
+        if (argc < 3) {
+            fprintf(stderr, "%s: latency requires duration argument\n", argv[0]);
+            exit(1);
+        }
+        value = strtol(argv[2], &p, 0);
+        if ((argv[2] == p) || (value <= 0)) {
+            fprintf(stderr, "%s: latency duration parse error\n", argv[0]);
+            exit(1);
+        }
+        setup_environment(argv[0]);
+        if (run_latency_test(argv[0], value, argc >= 4? argv[3]: NULL) < 0)
+            exit(1);
+    } else if (!strcmp(argv[1], "daemon")) {
+        setup_environment(argv[0]);
+        run_servo_daemon(argv[0], argc >= 3? argv[2]: ctl_socket_path);
+    } else if (!strcmp(argv[1], "ctl")) {
+        if (argc < 3) {
+            fprintf(stderr, "%s: ctl requires command\n", argv[0]);
+            exit(1);
+        }
+        if (servo_ctl_client(argv[0], ctl_socket_path, argc - 2, argv + 2) < 0)
+            exit(1);
+    } else if (!strcmp(argv[1], "setparams")) {
+        if (set_params(argv[0], argc - 2, argv + 2) < 0)
+            exit(1);
     } else {
         fprintf(stderr, "%s: unknown command %s\n"
-                        "Usage: %s <command> [argument]\n",
+                        "Usage: %s [options] <command> [argument]\n",
                     argv[0], argv[1], argv[0]);
          print_help(stderr);
          exit(1);
@@ -0,0 +1,119 @@
+/*
+ * Helpers for isolated real-time task launch
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <alloca.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "rt_launch.h"
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+/* Kernel ABI of sched_setattr(), glibc wrapper is not available */
+struct rt_launch_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t  sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+int rt_launch_set_deadline(uint64_t runtime_nsec, uint64_t deadline_nsec,
+                           uint64_t period_nsec)
+{
+  #ifdef SYS_sched_setattr
+    struct rt_launch_sched_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_runtime = runtime_nsec;
+    attr.sched_deadline = deadline_nsec;
+    attr.sched_period = period_nsec;
+
+    if (syscall(SYS_sched_setattr, 0, &attr, 0) == -1) {
+        int err = errno;
+
+        perror("sched_setattr SCHED_DEADLINE");
+        if (err == EPERM)
+            fprintf(stderr, "SCHED_DEADLINE requires CAP_SYS_NICE and CPU affinity"
+                            " spanning the whole root domain, use exclusive cpuset"
+                            " partition to run on isolated CPU\n");
+        return -1;
+    }
+
+    return 0;
+  #else /*SYS_sched_setattr*/
+    fprintf(stderr, "sched_setattr is not supported by C library headers\n");
+    return -1;
+  #endif /*SYS_sched_setattr*/
+}
+
+void rt_launch_prefault_stack(size_t size)
+{
+    volatile unsigned char *area = alloca(size);
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    size_t i;
+
+    for (i = 0; i < size; i += pagesize)
+        area[i] = 0;
+}
+
+int rt_launch_cpu_in_list(int cpu, const char *list_file)
+{
+    FILE *f;
+    char buf[256];
+    char *p;
+    long from, to;
+
+    f = fopen(list_file, "r");
+    if (f == NULL)
+        return -1;
+    if (fgets(buf, sizeof(buf), f) == NULL)
+        buf[0] = 0;
+    fclose(f);
+
+    /* cpulist format, i.e. "1-3,6" */
+    p = buf;
+    while (*p && (*p != '\n')) {
+        from = strtol(p, &p, 10);
+        to = from;
+        if (*p == '-')
+            to = strtol(p + 1, &p, 10);
+        if ((cpu >= from) && (cpu <= to))
+            return 1;
+        if (*p != ',')
+            break;
+        p++;
+    }
+
+    return 0;
+}
+
+long rt_launch_thread_faults(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_THREAD, &usage) == -1)
+        return -1;
+
+    return usage.ru_minflt + usage.ru_majflt;
+}
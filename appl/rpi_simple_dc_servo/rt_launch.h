@@ -0,0 +1,22 @@
+#ifndef _RT_LAUNCH_H
+#define _RT_LAUNCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RT_LAUNCH_STACK_SIZE   (256 * 1024)
+
+/* Switch calling thread to SCHED_DEADLINE policy */
+int rt_launch_set_deadline(uint64_t runtime_nsec, uint64_t deadline_nsec,
+                           uint64_t period_nsec);
+
+/* Touch stack area of given size to have it faulted in */
+void rt_launch_prefault_stack(size_t size);
+
+/* Returns 1 if CPU is listed in given sysfs cpulist file, 0 if not, -1 on error */
+int rt_launch_cpu_in_list(int cpu, const char *list_file);
+
+/* Sum of minor and major page faults of calling thread */
+long rt_launch_thread_faults(void);
+
+#endif /*_RT_LAUNCH_H*/
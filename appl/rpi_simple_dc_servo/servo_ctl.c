@@ -0,0 +1,104 @@
+/*
+ * Commands mailbox and status for rpi_simple_dc_servo daemon
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "servo_ctl.h"
+#include "servo_shm.h"
+
+servo_ctl_shm_t *servo_ctl_shm_create(void)
+{
+    servo_ctl_shm_t *shm;
+    pthread_mutexattr_t attr;
+
+    shm = servo_shm_map(NULL, sizeof(*shm), 1);
+    if (shm == NULL)
+        return NULL;
+
+    memset(shm, 0, sizeof(*shm));
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    if (pthread_mutex_init(&shm->prod_lock, &attr) != 0) {
+        pthread_mutexattr_destroy(&attr);
+        servo_shm_unmap(shm, sizeof(*shm));
+        return NULL;
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    __atomic_store_n(&shm->magic, SERVO_CTL_MAGIC, __ATOMIC_RELEASE);
+
+    return shm;
+}
+
+int servo_cmdq_push(servo_ctl_shm_t *shm, const servo_cmd_t *cmd)
+{
+    uint32_t head;
+    int ret = 0;
+
+    if (pthread_mutex_lock(&shm->prod_lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&shm->prod_lock);
+
+    head = shm->cmdq_head;
+    if (head - __atomic_load_n(&shm->cmdq_tail, __ATOMIC_ACQUIRE) >=
+        SERVO_CMDQ_SIZE) {
+        ret = -1;
+    } else {
+        shm->cmdq[head % SERVO_CMDQ_SIZE] = *cmd;
+        __atomic_store_n(&shm->cmdq_head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&shm->prod_lock);
+
+    return ret;
+}
+
+int servo_cmdq_pop(servo_ctl_shm_t *shm, servo_cmd_t *cmd)
+{
+    uint32_t tail = shm->cmdq_tail;
+
+    if (__atomic_load_n(&shm->cmdq_head, __ATOMIC_ACQUIRE) == tail)
+        return 0;
+
+    *cmd = shm->cmdq[tail % SERVO_CMDQ_SIZE];
+    __atomic_store_n(&shm->cmdq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+void servo_status_publish(servo_ctl_shm_t *shm, const servo_status_t *status)
+{
+    uint32_t seq = shm->status_seq;
+
+    __atomic_store_n(&shm->status_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shm->status = *status;
+    __atomic_store_n(&shm->status_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int servo_status_read(servo_ctl_shm_t *shm, servo_status_t *status)
+{
+    uint32_t seq;
+    int retry;
+
+    for (retry = 0; retry < 1000; retry++) {
+        seq = __atomic_load_n(&shm->status_seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1)) {
+            *status = shm->status;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&shm->status_seq, __ATOMIC_RELAXED) == seq)
+                return 0;
+        }
+        sched_yield();
+    }
+
+    return -1;
+}
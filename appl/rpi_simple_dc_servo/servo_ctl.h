@@ -0,0 +1,65 @@
+#ifndef _SERVO_CTL_H
+#define _SERVO_CTL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define SERVO_CTL_SOCKET_PATH  "/tmp/rpi_simple_dc_servo.sock"
+#define SERVO_CTL_MAGIC        0x53435431
+
+#define SERVO_CMDQ_SIZE        16  /* power of two */
+
+enum servo_cmd_code {
+    SERVO_CMD_NOP = 0,
+    SERVO_CMD_SETSPEED,
+    SERVO_CMD_SETPOS,
+    SERVO_CMD_STOP,
+};
+
+typedef struct servo_cmd_t {
+    uint32_t code;
+    int32_t  arg;
+} servo_cmd_t;
+
+typedef struct servo_status_t {
+    uint32_t periods;
+    uint32_t cmds_done;
+    int32_t  act_pos;
+    int32_t  ref_pos;
+    int32_t  act_speed;
+    int32_t  ctrl_action;
+    int32_t  ctrl_i_sum;
+    int64_t  req_speed_fract;
+} servo_status_t;
+
+/*
+ * Commands mailbox and status block internal to the daemon,
+ * external clients talk to it through the control socket only.
+ * Command queue is single consumer (RT task) lock-free ring,
+ * producers (socket client threads) are serialized by mutex
+ * which is never touched by RT task. Status is published
+ * by RT task under sequence counter.
+ */
+typedef struct servo_ctl_shm_t {
+    uint32_t magic;
+    pthread_mutex_t prod_lock;
+    uint32_t cmdq_head;
+    uint32_t cmdq_tail;
+    servo_cmd_t cmdq[SERVO_CMDQ_SIZE];
+    uint32_t status_seq;
+    servo_status_t status;
+} servo_ctl_shm_t;
+
+servo_ctl_shm_t *servo_ctl_shm_create(void);
+
+/* Producer side, returns -1 when queue is full */
+int servo_cmdq_push(servo_ctl_shm_t *shm, const servo_cmd_t *cmd);
+
+/* RT side, returns 1 when command has been fetched */
+int servo_cmdq_pop(servo_ctl_shm_t *shm, servo_cmd_t *cmd);
+
+void servo_status_publish(servo_ctl_shm_t *shm, const servo_status_t *status);
+
+int servo_status_read(servo_ctl_shm_t *shm, servo_status_t *status);
+
+#endif /*_SERVO_CTL_H*/
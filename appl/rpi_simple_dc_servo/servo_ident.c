@@ -0,0 +1,144 @@
+/*
+ * Frequency response measurement for rpi_simple_dc_servo
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * Goertzel recurrence s[n] = x[n] + 2 cos(w) s[n-1] - s[n-2]
+ * gives after N samples DFT bin X = s[N-1] - exp(-jw) s[N-2]
+ * up to phase factor common to all signals, which cancels
+ * in the computed ratios.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "servo_ident.h"
+
+int servo_ident_plan(servo_ident_t *id, double amplitude, double fmin, double fmax,
+                     int n_freq, double period)
+{
+    double fs = 1 / period;
+    double f;
+    double cycles;
+    double w;
+    int i;
+
+    if ((fmin <= 0) || (fmax < fmin) || (fmax >= fs / 2) || (n_freq < 1) ||
+        (n_freq > SERVO_IDENT_MAX_FREQ) || (amplitude <= 0))
+        return -1;
+
+    memset(id, 0, sizeof(*id));
+    id->n_freq = n_freq;
+    id->amplitude = amplitude;
+
+    for (i = 0; i < n_freq; i++) {
+        if (n_freq > 1)
+            f = fmin * pow(fmax / fmin, (double)i / (n_freq - 1));
+        else
+            f = fmin;
+
+        cycles = ceil(f * SERVO_IDENT_MIN_TIME);
+        if (cycles < SERVO_IDENT_MIN_CYCLES)
+            cycles = SERVO_IDENT_MIN_CYCLES;
+        id->measure[i] = lround(cycles * fs / f);
+        /* Exactly integer number of cycles in the window */
+        f = cycles * fs / id->measure[i];
+        id->freq[i] = f;
+
+        cycles = ceil(f * SERVO_IDENT_SETTLE_TIME);
+        if (cycles < SERVO_IDENT_SETTLE_CYCLES)
+            cycles = SERVO_IDENT_SETTLE_CYCLES;
+        id->settle[i] = lround(cycles * fs / f);
+
+        w = 2 * M_PI * f * period;
+        id->coef[i] = 2 * cos(w);
+        id->sinw[i] = sin(w);
+    }
+
+    /* Oscillator sin(w n) starts from zero */
+    id->idx = 0;
+    id->left = id->settle[0];
+    id->osc[0] = -id->sinw[0];
+    id->osc[1] = -id->sinw[0] * id->coef[0];
+
+    return 0;
+}
+
+void servo_ident_update(servo_ident_t *id, double act, double pos)
+{
+    double x[SERVO_IDENT_SIGNALS];
+    double coef;
+    double s;
+    int idx = id->idx;
+    int i;
+
+    if (id->done)
+        return;
+
+    coef = id->coef[idx];
+
+    if (id->measuring) {
+        x[SERVO_IDENT_EXC] = id->exc;
+        x[SERVO_IDENT_ACT] = act;
+        x[SERVO_IDENT_POS] = pos;
+        for (i = 0; i < SERVO_IDENT_SIGNALS; i++) {
+            s = x[i] + coef * id->acc[i][0] - id->acc[i][1];
+            id->acc[i][1] = id->acc[i][0];
+            id->acc[i][0] = s;
+        }
+    }
+
+    if (--id->left == 0) {
+        if (!id->measuring) {
+            id->measuring = 1;
+            id->left = id->measure[idx];
+            memset(id->acc, 0, sizeof(id->acc));
+        } else {
+            for (i = 0; i < SERVO_IDENT_SIGNALS; i++) {
+                id->re[idx][i] = id->acc[i][0] - id->acc[i][1] * coef / 2;
+                id->im[idx][i] = id->acc[i][1] * id->sinw[idx];
+            }
+            id->measuring = 0;
+            if (++idx >= id->n_freq) {
+                id->exc = 0;
+                __atomic_store_n(&id->done, 1, __ATOMIC_RELEASE);
+                return;
+            }
+            id->idx = idx;
+            id->left = id->settle[idx];
+            coef = id->coef[idx];
+            id->osc[0] = -id->sinw[idx];
+            id->osc[1] = -id->sinw[idx] * coef;
+        }
+    }
+
+    /* Next excitation sample */
+    s = coef * id->osc[0] - id->osc[1];
+    id->osc[1] = id->osc[0];
+    id->osc[0] = s;
+    id->exc = id->amplitude * s;
+}
+
+void servo_ident_ratio(const servo_ident_t *id, int idx, int num, int den,
+                       double *mag, double *phase_deg)
+{
+    double nre = id->re[idx][num];
+    double nim = id->im[idx][num];
+    double dre = id->re[idx][den];
+    double dim = id->im[idx][den];
+    double d = dre * dre + dim * dim;
+    double re, im;
+
+    if (d == 0) {
+        *mag = 0;
+        *phase_deg = 0;
+        return;
+    }
+
+    re = (nre * dre + nim * dim) / d;
+    im = (nim * dre - nre * dim) / d;
+
+    *mag = hypot(re, im);
+    *phase_deg = atan2(im, re) * 180 / M_PI;
+}
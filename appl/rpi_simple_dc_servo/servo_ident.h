@@ -0,0 +1,72 @@
+#ifndef _SERVO_IDENT_H
+#define _SERVO_IDENT_H
+
+#include <stdint.h>
+
+#define SERVO_IDENT_MAX_FREQ   64
+#define SERVO_IDENT_MIN_CYCLES 4     /* measurement window */
+#define SERVO_IDENT_MIN_TIME   0.5   /* measurement window [s] */
+#define SERVO_IDENT_SETTLE_CYCLES 2
+#define SERVO_IDENT_SETTLE_TIME   0.2
+
+enum servo_ident_signal {
+    SERVO_IDENT_EXC = 0,   /* injected excitation */
+    SERVO_IDENT_ACT,       /* action applied to the plant */
+    SERVO_IDENT_POS,       /* measured position */
+    SERVO_IDENT_SIGNALS
+};
+
+/*
+ * Stepped-sine frequency response measurement. For each frequency
+ * the excitation settles for settle[] periods, then single DFT bin
+ * of each signal is accumulated by Goertzel recurrence over exactly
+ * integer number of excitation cycles in measure[] periods.
+ * Excitation itself is produced by the same recurrence, so RT side
+ * needs no trigonometric functions and no sample buffers.
+ */
+typedef struct servo_ident_t {
+    /* Plan, prepared by servo_ident_plan() */
+    int      n_freq;
+    double   amplitude;
+    double   freq[SERVO_IDENT_MAX_FREQ];
+    uint32_t settle[SERVO_IDENT_MAX_FREQ];
+    uint32_t measure[SERVO_IDENT_MAX_FREQ];
+    double   coef[SERVO_IDENT_MAX_FREQ];   /* 2 cos(omega T) */
+    double   sinw[SERVO_IDENT_MAX_FREQ];   /* sin(omega T) */
+
+    /* RT state */
+    int      idx;
+    uint32_t left;
+    int      measuring;
+    double   osc[2];
+    double   acc[SERVO_IDENT_SIGNALS][2];
+    double   exc;
+
+    /* Results, valid when done is set */
+    double   re[SERVO_IDENT_MAX_FREQ][SERVO_IDENT_SIGNALS];
+    double   im[SERVO_IDENT_MAX_FREQ][SERVO_IDENT_SIGNALS];
+    volatile int done;
+} servo_ident_t;
+
+/*
+ * Logarithmically spaced frequencies in Hz, each is adjusted to fit
+ * integer number of cycles into the measurement window.
+ * Returns -1 for invalid range.
+ */
+int servo_ident_plan(servo_ident_t *id, double amplitude, double fmin, double fmax,
+                     int n_freq, double period);
+
+/* RT side, excitation for the actual period */
+static inline double servo_ident_excite(servo_ident_t *id)
+{
+    return id->exc;
+}
+
+/* RT side, called after the period with values of the signals */
+void servo_ident_update(servo_ident_t *id, double act, double pos);
+
+/* Ratio of two signals at frequency index, magnitude and phase in degrees */
+void servo_ident_ratio(const servo_ident_t *id, int idx, int num, int den,
+                       double *mag, double *phase_deg);
+
+#endif /*_SERVO_IDENT_H*/
@@ -0,0 +1,115 @@
+/*
+ * Jerk-limited move generator for rpi_simple_dc_servo
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * The seven phases are: jerk up, constant acceleration, jerk down,
+ * cruise, jerk down, constant deceleration, jerk up. Phase lengths
+ * are rounded up to whole samples and the jerk is then rescaled
+ * so that exact discrete integration ends at the target.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "servo_move.h"
+
+/* Distance covered by discrete integration with unit jerk */
+static double servo_move_unit_dist(const servo_move_t *mv, const int sign[])
+{
+    double acc = 0, vel = 0, pos = 0;
+    uint32_t i;
+    int phase;
+
+    for (phase = 0; phase < SERVO_MOVE_PHASES; phase++) {
+        for (i = 0; i < mv->count[phase]; i++) {
+            acc += sign[phase];
+            vel += acc;
+            pos += vel;
+        }
+    }
+    return pos;
+}
+
+int servo_move_plan(servo_move_t *mv, uint64_t start_fract, uint32_t target,
+                    double vmax, double amax, double jmax, double period)
+{
+    static const int sign[SERVO_MOVE_PHASES] = {1, 0, -1, 0, -1, 0, 1};
+    double dist;
+    double v, a, j;
+    double tj, ta, tc;
+    double unit_dist;
+    double jerk;
+    int dir;
+    int phase;
+
+    memset(mv, 0, sizeof(*mv));
+    mv->pos_fract = start_fract;
+    mv->target = target;
+    mv->phase = -1;
+
+    if ((vmax <= 0) || (amax <= 0) || (jmax < 0) || (period <= 0))
+        return -1;
+
+    dist = (double)(int32_t)(target - (uint32_t)(start_fract >> 32)) -
+           (double)(uint32_t)start_fract / 4294967296.0;
+    dir = dist < 0? -1: 1;
+    dist = fabs(dist);
+
+    /* Limits per sample */
+    v = vmax * period;
+    a = amax * period * period;
+    j = jmax * period * period * period;
+
+    if (dist < 1e-9) {
+        mv->phase = SERVO_MOVE_PHASES - 1;
+        return 0;
+    }
+
+    if (j <= 0) {
+        tj = 1;           /* trapezoidal profile */
+        j = a;
+    } else {
+        tj = a / j;
+    }
+
+    if (v < a * tj) {
+        /* Maximal acceleration is not reached */
+        tj = sqrt(v / j);
+        ta = 0;
+    } else {
+        ta = v / a - tj;
+    }
+
+    if (v * (2 * tj + ta) > dist) {
+        /* Maximal velocity is not reached */
+        ta = 0;
+        tj = cbrt(dist / (2 * j));
+        if (j * tj <= a) {
+            v = j * tj * tj;
+        } else {
+            tj = a / j;
+            v = (-tj + sqrt(tj * tj + 4 * dist / a)) * a / 2;
+            ta = v / a - tj;
+            if (ta < 0)
+                ta = 0;
+        }
+    }
+    tc = dist / v - (2 * tj + ta);
+    if (tc < 0)
+        tc = 0;
+
+    mv->count[0] = mv->count[2] = mv->count[4] = mv->count[6] =
+        tj < 1? 1: (uint32_t)ceil(tj);
+    mv->count[1] = mv->count[5] = (uint32_t)ceil(ta);
+    mv->count[3] = (uint32_t)ceil(tc);
+
+    unit_dist = servo_move_unit_dist(mv, sign);
+    jerk = dist / unit_dist * ldexp(1.0, SERVO_MOVE_FRACT_BITS);
+
+    for (phase = 0; phase < SERVO_MOVE_PHASES; phase++)
+        mv->jerk[phase] = (int64_t)llround(jerk) * sign[phase] * dir;
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef _SERVO_MOVE_H
+#define _SERVO_MOVE_H
+
+#include <stdint.h>
+
+#define SERVO_MOVE_PHASES      7
+#define SERVO_MOVE_FRACT_BITS  48  /* velocity, acceleration and jerk fraction */
+
+/*
+ * Incremental jerk-limited (S-curve) or trapezoidal move.
+ * Profile is planned once per move (floating point allowed),
+ * each sample is then advanced by integer additions only.
+ * Position is in the same 32.32 format as ref_pos_fract,
+ * velocity, acceleration and jerk are in counts per sample
+ * powers with SERVO_MOVE_FRACT_BITS fractional bits.
+ */
+typedef struct servo_move_t {
+    uint64_t pos_fract;
+    int64_t  vel;
+    int64_t  acc;
+    int64_t  jerk[SERVO_MOVE_PHASES];
+    uint32_t count[SERVO_MOVE_PHASES];
+    uint32_t target;
+    uint32_t left;
+    int      phase;
+    int      done;
+} servo_move_t;
+
+/*
+ * Plan move from start to target position, limits are in IRC counts
+ * per second, per second^2 and per second^3. Zero jmax selects
+ * trapezoidal profile. Returns -1 for invalid limits.
+ */
+int servo_move_plan(servo_move_t *mv, uint64_t start_fract, uint32_t target,
+                    double vmax, double amax, double jmax, double period);
+
+/* Advance one sample, returns 0 when the move is finished */
+static inline int servo_move_next(servo_move_t *mv, uint64_t *ref_pos_fract)
+{
+    while (!mv->left) {
+        if (++mv->phase >= SERVO_MOVE_PHASES) {
+            /* Snap to exact target, removes fixed-point residue */
+            mv->pos_fract = (uint64_t)mv->target << 32;
+            mv->vel = 0;
+            mv->acc = 0;
+            mv->phase = SERVO_MOVE_PHASES - 1;
+            *ref_pos_fract = mv->pos_fract;
+            /* Polled by the monitor thread */
+            __atomic_store_n(&mv->done, 1, __ATOMIC_RELEASE);
+            return 0;
+        }
+        mv->left = mv->count[mv->phase];
+    }
+    mv->left--;
+
+    mv->acc += mv->jerk[mv->phase];
+    mv->vel += mv->acc;
+    mv->pos_fract += mv->vel >> (SERVO_MOVE_FRACT_BITS - 32);
+    *ref_pos_fract = mv->pos_fract;
+
+    return 1;
+}
+
+#endif /*_SERVO_MOVE_H*/
@@ -0,0 +1,25 @@
+/*
+ * Velocity observer for rpi_simple_dc_servo
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * Second order tracking loop, the position estimate is predicted
+ * by the estimated velocity and both are corrected by the prediction
+ * error. The loop is well damped for vel_shift between
+ * 2 * pos_shift + 1 and 2 * pos_shift + 2 (critical damping)
+ * and its bandwidth is approximately 2^-pos_shift of the sampling
+ * frequency.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "servo_obs.h"
+
+void servo_obs_init(servo_obs_t *obs, uint32_t pos, int pos_shift, int vel_shift)
+{
+    memset(obs, 0, sizeof(*obs));
+    obs->pos_fract = ((uint64_t)pos << 32) + (1ULL << 31);
+    obs->pos_shift = pos_shift;
+    obs->vel_shift = vel_shift;
+}
@@ -0,0 +1,47 @@
+#ifndef _SERVO_OBS_H
+#define _SERVO_OBS_H
+
+#include <stdint.h>
+
+/* Estimate is resynchronized when it looses the encoder by more counts */
+#define SERVO_OBS_RESYNC_COUNTS  256
+
+/*
+ * Tracking loop (alpha-beta/PLL) velocity observer fed by IRC counts.
+ * Position is in the same 32.32 format as ref_pos_fract, velocity
+ * is in counts per sample with 32 fractional bits. Gains are powers
+ * of two so update takes a few integer additions and shifts only.
+ */
+typedef struct servo_obs_t {
+    uint64_t pos_fract;
+    int64_t  vel_fract;
+    int      pos_shift;
+    int      vel_shift;
+    uint32_t resyncs;
+} servo_obs_t;
+
+void servo_obs_init(servo_obs_t *obs, uint32_t pos, int pos_shift, int vel_shift);
+
+static inline void servo_obs_update(servo_obs_t *obs, uint32_t pos)
+{
+    uint64_t pred;
+    int64_t err;
+
+    pred = obs->pos_fract + obs->vel_fract;
+
+    /* Count covers interval [pos, pos + 1), compare with its center */
+    err = (int64_t)(((uint64_t)pos << 32) + (1ULL << 31) - pred);
+
+    if ((err > ((int64_t)SERVO_OBS_RESYNC_COUNTS << 32)) ||
+        (err < -((int64_t)SERVO_OBS_RESYNC_COUNTS << 32))) {
+        /* Position offset change or lost samples */
+        obs->pos_fract = pred + err;
+        obs->resyncs++;
+        return;
+    }
+
+    obs->pos_fract = pred + (err >> obs->pos_shift);
+    obs->vel_fract += err >> obs->vel_shift;
+}
+
+#endif /*_SERVO_OBS_H*/
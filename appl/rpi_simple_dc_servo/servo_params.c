@@ -0,0 +1,112 @@
+/*
+ * Live update of rpi_simple_dc_servo controller parameters
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * The controller polls the block at period boundary and never
+ * blocks on the writer. Only one writer (tuning tool instance)
+ * is expected at given time.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "servo_params.h"
+#include "servo_shm.h"
+
+servo_params_shm_t *servo_params_shm_create(const servo_params_t *prm)
+{
+    servo_params_shm_t *shm;
+
+    shm = servo_shm_map(SERVO_PARAMS_SHM_NAME, sizeof(*shm), 1);
+    if (shm == NULL)
+        return NULL;
+
+    memset(shm, 0, sizeof(*shm));
+    shm->buf[0].prm = *prm;
+    shm->buf[1].prm = *prm;
+    shm->version = 1;
+    shm->applied_version = 1;
+    __atomic_store_n(&shm->magic, SERVO_PARAMS_MAGIC, __ATOMIC_RELEASE);
+
+    return shm;
+}
+
+servo_params_shm_t *servo_params_shm_attach(void)
+{
+    servo_params_shm_t *shm;
+
+    shm = servo_shm_map(SERVO_PARAMS_SHM_NAME, sizeof(*shm), 0);
+    if (shm == NULL)
+        return NULL;
+
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != SERVO_PARAMS_MAGIC) {
+        servo_shm_unmap(shm, sizeof(*shm));
+        return NULL;
+    }
+
+    return shm;
+}
+
+void servo_params_shm_release(servo_params_shm_t *shm)
+{
+    servo_shm_unmap(shm, sizeof(*shm));
+}
+
+void servo_params_shm_remove(void)
+{
+    servo_shm_remove(SERVO_PARAMS_SHM_NAME);
+}
+
+void servo_params_read(servo_params_shm_t *shm, servo_params_t *prm)
+{
+    uint32_t idx = __atomic_load_n(&shm->active, __ATOMIC_ACQUIRE);
+
+    *prm = shm->buf[idx & 1].prm;
+}
+
+uint32_t servo_params_publish(servo_params_shm_t *shm, const servo_params_t *prm)
+{
+    uint32_t idx = __atomic_load_n(&shm->active, __ATOMIC_RELAXED) ^ 1;
+    uint32_t seq = shm->buf[idx].seq;
+
+    __atomic_store_n(&shm->buf[idx].seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    shm->buf[idx].prm = *prm;
+
+    __atomic_store_n(&shm->buf[idx].seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm->active, idx, __ATOMIC_RELEASE);
+
+    return __atomic_add_fetch(&shm->version, 1, __ATOMIC_RELEASE);
+}
+
+int servo_params_poll(servo_params_shm_t *shm, servo_params_t *prm,
+                      uint32_t *last_version)
+{
+    uint32_t version;
+    uint32_t idx;
+    uint32_t seq;
+    servo_params_t tmp;
+
+    version = __atomic_load_n(&shm->version, __ATOMIC_ACQUIRE);
+    if (version == *last_version)
+        return 0;
+
+    idx = __atomic_load_n(&shm->active, __ATOMIC_ACQUIRE) & 1;
+    seq = __atomic_load_n(&shm->buf[idx].seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+        return 0;
+
+    tmp = shm->buf[idx].prm;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shm->buf[idx].seq, __ATOMIC_RELAXED) != seq)
+        return 0;
+
+    *prm = tmp;
+    *last_version = version;
+    __atomic_store_n(&shm->applied_version, version, __ATOMIC_RELEASE);
+
+    return 1;
+}
@@ -0,0 +1,58 @@
+#ifndef _SERVO_PARAMS_H
+#define _SERVO_PARAMS_H
+
+#include <stdint.h>
+
+#define SERVO_PARAMS_SHM_NAME  "/rpi_simple_dc_servo_params"
+#define SERVO_PARAMS_MAGIC     0x53505231
+
+/* Adjust integrator to keep action continuous at gains swap */
+#define SERVO_PARAMS_BUMPLESS  0x0001
+
+typedef struct servo_params_t {
+    int32_t  ctrl_p;
+    int32_t  ctrl_i;
+    int32_t  ctrl_d;
+    uint32_t pwm_max;
+    uint32_t sample_period_nsec;
+    uint32_t flags;
+} servo_params_t;
+
+/*
+ * Double-buffered parameters block shared between controller
+ * and tuning tool. The writer fills the inactive buffer, then
+ * publishes its index and increments version. Each buffer is
+ * guarded by sequence counter (odd while written) so
+ * the controller detects torn read and retries in the next
+ * period instead of waiting for the writer.
+ */
+typedef struct servo_params_shm_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t active;
+    uint32_t applied_version;
+    struct {
+        uint32_t seq;
+        servo_params_t prm;
+    } buf[2];
+} servo_params_shm_t;
+
+servo_params_shm_t *servo_params_shm_create(const servo_params_t *prm);
+
+servo_params_shm_t *servo_params_shm_attach(void);
+
+void servo_params_shm_release(servo_params_shm_t *shm);
+
+/* Controller side, called at exit to remove the named object */
+void servo_params_shm_remove(void);
+
+/* Non-RT side, single writer */
+void servo_params_read(servo_params_shm_t *shm, servo_params_t *prm);
+
+uint32_t servo_params_publish(servo_params_shm_t *shm, const servo_params_t *prm);
+
+/* RT side, returns 1 when new parameters set has been copied to prm */
+int servo_params_poll(servo_params_shm_t *shm, servo_params_t *prm,
+                      uint32_t *last_version);
+
+#endif /*_SERVO_PARAMS_H*/
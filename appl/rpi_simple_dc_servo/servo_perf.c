@@ -0,0 +1,262 @@
+/*
+ * Hardware performance counters for rpi_simple_dc_servo control step
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "servo_perf.h"
+
+const char *servo_perf_names[SERVO_PERF_CNT] = {
+    [SERVO_PERF_CYCLES] = "cycles",
+    [SERVO_PERF_INSTRUCTIONS] = "instructions",
+    [SERVO_PERF_CACHE_MISSES] = "cache-misses",
+};
+
+static const uint64_t servo_perf_config[SERVO_PERF_CNT] = {
+    [SERVO_PERF_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+    [SERVO_PERF_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+    [SERVO_PERF_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+};
+
+static int servo_perf_event_open(uint64_t config, int group_fd, int exclude_kernel)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+
+static inline uint64_t servo_perf_rdpmc(unsigned int counter)
+{
+    uint32_t low, high;
+
+    __asm__ volatile("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+    return low | ((uint64_t)high << 32);
+}
+
+/* Userspace counter read protocol described in linux/perf_event.h */
+static inline int servo_perf_mmap_read(void *page, uint64_t *val)
+{
+    volatile struct perf_event_mmap_page *pc = page;
+    uint32_t seq, idx;
+    uint64_t count;
+    int64_t pmc;
+
+    do {
+        seq = pc->lock;
+        __asm__ volatile("" ::: "memory");
+        idx = pc->index;
+        count = pc->offset;
+        if (!pc->cap_user_rdpmc || !idx)
+            return -1;
+        pmc = servo_perf_rdpmc(idx - 1);
+        pmc <<= 64 - pc->pmc_width;
+        pmc >>= 64 - pc->pmc_width;
+        count += pmc;
+        __asm__ volatile("" ::: "memory");
+    } while (pc->lock != seq);
+
+    *val = count;
+    return 0;
+}
+
+#else /*x86*/
+
+static inline int servo_perf_mmap_read(void *page, uint64_t *val)
+{
+    /* Userspace counter access is not enabled on ARM by default */
+    return -1;
+}
+
+#endif /*x86*/
+
+static inline void servo_perf_read(servo_perf_t *perf, uint64_t *val)
+{
+    uint64_t buf[1 + SERVO_PERF_CNT];
+    int i;
+
+    if (perf->use_rdpmc) {
+        for (i = 0; i < perf->nr_cnt; i++)
+            servo_perf_mmap_read(perf->mmap_page[i], &val[i]);
+        return;
+    }
+
+    /* PERF_FORMAT_GROUP layout: nr, values[nr] */
+    if (read(perf->fd[0], buf, sizeof(uint64_t) * (1 + perf->nr_cnt)) <= 0)
+        return;
+    for (i = 0; i < perf->nr_cnt; i++)
+        val[i] = buf[1 + i];
+}
+
+static void servo_perf_reset_window(servo_perf_t *perf)
+{
+    int i;
+
+    perf->count = 0;
+    for (i = 0; i < SERVO_PERF_CNT; i++) {
+        perf->min[i] = UINT64_MAX;
+        perf->max[i] = 0;
+        perf->sum[i] = 0;
+    }
+}
+
+int servo_perf_open(servo_perf_t *perf, uint32_t window)
+{
+    int i;
+    int exclude_kernel = 0;
+    uint64_t val;
+    long pagesize = sysconf(_SC_PAGESIZE);
+
+    memset(perf, 0, sizeof(*perf));
+    for (i = 0; i < SERVO_PERF_CNT; i++)
+        perf->fd[i] = -1;
+
+    perf->fd[0] = servo_perf_event_open(servo_perf_config[0], -1, exclude_kernel);
+    if (perf->fd[0] == -1) {
+        /* perf_event_paranoid can restrict counting to userspace */
+        exclude_kernel = 1;
+        perf->fd[0] = servo_perf_event_open(servo_perf_config[0], -1, exclude_kernel);
+    }
+    if (perf->fd[0] == -1) {
+        perror("perf_event_open");
+        return -1;
+    }
+    perf->nr_cnt = 1;
+
+    for (i = 1; i < SERVO_PERF_CNT; i++) {
+        perf->fd[i] = servo_perf_event_open(servo_perf_config[i], perf->fd[0],
+                                            exclude_kernel);
+        if (perf->fd[i] == -1) {
+            fprintf(stderr, "perf counter %s is not available\n",
+                    servo_perf_names[i]);
+            break;
+        }
+        perf->nr_cnt++;
+    }
+
+    perf->use_rdpmc = 1;
+    for (i = 0; i < perf->nr_cnt; i++) {
+        perf->mmap_page[i] = mmap(NULL, pagesize, PROT_READ, MAP_SHARED,
+                                  perf->fd[i], 0);
+        if (perf->mmap_page[i] == MAP_FAILED) {
+            perf->mmap_page[i] = NULL;
+            perf->use_rdpmc = 0;
+        }
+    }
+
+    ioctl(perf->fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    /* Counter index is valid only after the group is scheduled in */
+    sched_yield();
+    for (i = 0; perf->use_rdpmc && (i < perf->nr_cnt); i++)
+        if (servo_perf_mmap_read(perf->mmap_page[i], &val) < 0)
+            perf->use_rdpmc = 0;
+
+    perf->window = window;
+    servo_perf_reset_window(perf);
+
+    return 0;
+}
+
+void servo_perf_close(servo_perf_t *perf)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    int i;
+
+    for (i = 0; i < SERVO_PERF_CNT; i++) {
+        if (perf->mmap_page[i] != NULL)
+            munmap(perf->mmap_page[i], pagesize);
+        if (perf->fd[i] != -1)
+            close(perf->fd[i]);
+        perf->mmap_page[i] = NULL;
+        perf->fd[i] = -1;
+    }
+    perf->nr_cnt = 0;
+}
+
+void servo_perf_begin(servo_perf_t *perf)
+{
+    if (!perf->nr_cnt)
+        return;
+
+    servo_perf_read(perf, perf->start);
+}
+
+void servo_perf_end(servo_perf_t *perf)
+{
+    uint64_t val[SERVO_PERF_CNT];
+    uint64_t diff;
+    int i;
+
+    if (!perf->nr_cnt)
+        return;
+
+    servo_perf_read(perf, val);
+
+    for (i = 0; i < perf->nr_cnt; i++) {
+        diff = val[i] - perf->start[i];
+        perf->sum[i] += diff;
+        if (diff < perf->min[i])
+            perf->min[i] = diff;
+        if (diff > perf->max[i])
+            perf->max[i] = diff;
+    }
+
+    if (++perf->count < perf->window)
+        return;
+
+    /* Publish completed window, divisions are done once per window */
+    __atomic_store_n(&perf->report.seq, perf->report.seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    perf->report.count = perf->count;
+    for (i = 0; i < perf->nr_cnt; i++) {
+        perf->report.min[i] = perf->min[i];
+        perf->report.mean[i] = perf->sum[i] / perf->count;
+        perf->report.max[i] = perf->max[i];
+    }
+    __atomic_store_n(&perf->report.seq, perf->report.seq + 1, __ATOMIC_RELEASE);
+
+    servo_perf_reset_window(perf);
+}
+
+int servo_perf_report_read(servo_perf_t *perf, servo_perf_report_t *report)
+{
+    uint32_t seq;
+    int retry;
+
+    for (retry = 0; retry < 1000; retry++) {
+        seq = __atomic_load_n(&perf->report.seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1)) {
+            *report = perf->report;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&perf->report.seq, __ATOMIC_RELAXED) == seq)
+                return seq? 0: -1;
+        }
+        sched_yield();
+    }
+
+    return -1;
+}
@@ -0,0 +1,55 @@
+#ifndef _SERVO_PERF_H
+#define _SERVO_PERF_H
+
+#include <stdint.h>
+
+enum {
+    SERVO_PERF_CYCLES = 0,
+    SERVO_PERF_INSTRUCTIONS,
+    SERVO_PERF_CACHE_MISSES,
+    SERVO_PERF_CNT
+};
+
+typedef struct servo_perf_report_t {
+    uint32_t seq;
+    uint32_t count;
+    uint64_t min[SERVO_PERF_CNT];
+    uint64_t mean[SERVO_PERF_CNT];
+    uint64_t max[SERVO_PERF_CNT];
+} servo_perf_report_t;
+
+/*
+ * Per-thread hardware counters sampled around one control step.
+ * Counters are opened as one group, read by rdpmc where
+ * the kernel allows userspace access (x86), by single read()
+ * of the group otherwise.
+ */
+typedef struct servo_perf_t {
+    int      fd[SERVO_PERF_CNT];
+    void     *mmap_page[SERVO_PERF_CNT];
+    int      use_rdpmc;
+    int      nr_cnt;
+    uint32_t window;
+    uint32_t count;
+    uint64_t start[SERVO_PERF_CNT];
+    uint64_t min[SERVO_PERF_CNT];
+    uint64_t max[SERVO_PERF_CNT];
+    uint64_t sum[SERVO_PERF_CNT];
+    servo_perf_report_t report;
+} servo_perf_t;
+
+extern const char *servo_perf_names[SERVO_PERF_CNT];
+
+/* Has to be called from the measured thread */
+int servo_perf_open(servo_perf_t *perf, uint32_t window);
+
+void servo_perf_close(servo_perf_t *perf);
+
+void servo_perf_begin(servo_perf_t *perf);
+
+void servo_perf_end(servo_perf_t *perf);
+
+/* Copy last completed window statistics, returns -1 if not available */
+int servo_perf_report_read(servo_perf_t *perf, servo_perf_report_t *report);
+
+#endif /*_SERVO_PERF_H*/
@@ -0,0 +1,119 @@
+/*
+ * Triggered signals capture for rpi_simple_dc_servo
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * Only the writer thread touches files, RT task hands over
+ * the frozen ring by the state change and semaphore post
+ * (async-signal-safe, never blocks).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "servo_scope.h"
+
+int servo_scope_init(servo_scope_t *sc, uint32_t pre, uint32_t post)
+{
+    if ((uint64_t)pre + post + 1 > SERVO_SCOPE_LEN)
+        return -1;
+
+    sc->pre = pre;
+    sc->post = post;
+    sc->state = SERVO_SCOPE_IDLE;
+    sc->wr = 0;
+    sc->filled = 0;
+    sc->captures = 0;
+    sc->missed = 0;
+
+    return 0;
+}
+
+static void servo_scope_arm(servo_scope_t *sc)
+{
+    sc->filled = 0;
+    __atomic_store_n(&sc->state, SERVO_SCOPE_ARMED, __ATOMIC_RELEASE);
+}
+
+int servo_scope_write(servo_scope_t *sc, FILE *fout)
+{
+    uint32_t i;
+    uint32_t start = sc->trig_wr - sc->filled;
+    uint32_t end = sc->trig_wr + sc->post;
+    servo_scope_sample_t *smp;
+
+    fprintf(fout, "# trigger%s%s%s at period %lu, missed %lu\n",
+            sc->trig_cause & SERVO_SCOPE_TRIG_ERR? " err": "",
+            sc->trig_cause & SERVO_SCOPE_TRIG_SAT? " sat": "",
+            sc->trig_cause & SERVO_SCOPE_TRIG_LATE? " late": "",
+            (unsigned long)sc->buf[sc->trig_wr % SERVO_SCOPE_LEN].period,
+            (unsigned long)sc->missed);
+    fprintf(fout, "# sample period ref_pos act_pos err action i_sum late_ns\n");
+
+    for (i = start; i != end + 1; i++) {
+        smp = &sc->buf[i % SERVO_SCOPE_LEN];
+        fprintf(fout, "%ld %lu %ld %ld %ld %ld %ld %ld\n", (long)(int32_t)(i - sc->trig_wr),
+                (unsigned long)smp->period, (long)smp->ref_pos, (long)smp->act_pos,
+                (long)(smp->ref_pos - smp->act_pos), (long)smp->action,
+                (long)smp->i_sum, (long)smp->late);
+    }
+
+    return ferror(fout)? -1: 0;
+}
+
+static void *servo_scope_writer(void *arg)
+{
+    servo_scope_t *sc = (servo_scope_t *)arg;
+    char name[256];
+    FILE *fout;
+
+    while (1) {
+        while (sem_wait(&sc->frozen_sem) == -1 && errno == EINTR)
+            ;
+
+        snprintf(name, sizeof(name), "%s.%03lu", sc->file_prefix,
+                 (unsigned long)sc->captures);
+        fout = fopen(name, "w");
+        if (fout == NULL) {
+            fprintf(stderr, "scope: cannot open %s: %s\n", name, strerror(errno));
+        } else {
+            if (servo_scope_write(sc, fout) < 0)
+                fprintf(stderr, "scope: write to %s failed\n", name);
+            fclose(fout);
+        }
+
+        sc->captures++;
+        if (sc->max_captures && (sc->captures >= sc->max_captures))
+            __atomic_store_n(&sc->state, SERVO_SCOPE_IDLE, __ATOMIC_RELEASE);
+        else
+            servo_scope_arm(sc);
+    }
+
+    return NULL;
+}
+
+int servo_scope_start(servo_scope_t *sc)
+{
+    if (sem_init(&sc->frozen_sem, 0, 0) == -1)
+        return -1;
+
+    if (pthread_create(&sc->writer, NULL, servo_scope_writer, sc) != 0) {
+        sem_destroy(&sc->frozen_sem);
+        return -1;
+    }
+
+    servo_scope_arm(sc);
+
+    return 0;
+}
+
+void servo_scope_sync(servo_scope_t *sc)
+{
+    while (__atomic_load_n(&sc->state, __ATOMIC_ACQUIRE) == SERVO_SCOPE_FROZEN)
+        usleep(1000);
+}
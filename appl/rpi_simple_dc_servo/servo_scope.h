@@ -0,0 +1,130 @@
+#ifndef _SERVO_SCOPE_H
+#define _SERVO_SCOPE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define SERVO_SCOPE_LEN        8192  /* power of two */
+
+#define SERVO_SCOPE_TRIG_ERR   0x0001  /* |ref_pos - act_pos| > err_limit */
+#define SERVO_SCOPE_TRIG_SAT   0x0002  /* |action| >= act_limit */
+#define SERVO_SCOPE_TRIG_LATE  0x0004  /* wake-up later than late_limit */
+
+enum servo_scope_state {
+    SERVO_SCOPE_IDLE = 0,
+    SERVO_SCOPE_ARMED,
+    SERVO_SCOPE_TRIGGERED,
+    SERVO_SCOPE_FROZEN,
+};
+
+typedef struct servo_scope_sample_t {
+    uint32_t period;
+    int32_t  ref_pos;
+    int32_t  act_pos;
+    int32_t  action;
+    int32_t  i_sum;
+    int32_t  late;
+} servo_scope_sample_t;
+
+/*
+ * Triggered capture of controller signals. While armed the RT task
+ * stores samples to the ring and checks trigger conditions, after
+ * the trigger it captures post samples and freezes the buffer.
+ * The frozen buffer is owned by the writer thread which stores
+ * the snapshot and arms the scope again.
+ */
+typedef struct servo_scope_t {
+    /* Configuration */
+    uint32_t trig_mask;
+    int32_t  err_limit;
+    int32_t  act_limit;
+    int32_t  late_limit;
+    uint32_t pre;
+    uint32_t post;
+    uint32_t max_captures;
+    const char *file_prefix;
+
+    /* RT state */
+    int      state;
+    uint32_t wr;
+    uint32_t filled;
+    uint32_t left;
+    uint32_t trig_wr;
+    uint32_t trig_cause;
+    uint32_t missed;
+
+    uint32_t captures;
+    sem_t    frozen_sem;
+    pthread_t writer;
+    servo_scope_sample_t buf[SERVO_SCOPE_LEN];
+} servo_scope_t;
+
+/* Returns -1 when pre and post samples do not fit into the ring */
+int servo_scope_init(servo_scope_t *sc, uint32_t pre, uint32_t post);
+
+/* Start writer thread and arm the scope */
+int servo_scope_start(servo_scope_t *sc);
+
+/* Wait until the frozen snapshot (if any) is written */
+void servo_scope_sync(servo_scope_t *sc);
+
+int servo_scope_write(servo_scope_t *sc, FILE *fout);
+
+/* RT side, called once per period */
+static inline void servo_scope_sample(servo_scope_t *sc, const servo_scope_sample_t *smp)
+{
+    uint32_t cause = 0;
+    int32_t err;
+    int state = __atomic_load_n(&sc->state, __ATOMIC_ACQUIRE);
+
+    if (state == SERVO_SCOPE_IDLE)
+        return;
+
+    if (state == SERVO_SCOPE_ARMED || state == SERVO_SCOPE_FROZEN) {
+        err = smp->ref_pos - smp->act_pos;
+        if ((sc->trig_mask & SERVO_SCOPE_TRIG_ERR) &&
+            ((err > sc->err_limit) || (err < -sc->err_limit)))
+            cause |= SERVO_SCOPE_TRIG_ERR;
+        if ((sc->trig_mask & SERVO_SCOPE_TRIG_SAT) &&
+            ((smp->action >= sc->act_limit) || (smp->action <= -sc->act_limit)))
+            cause |= SERVO_SCOPE_TRIG_SAT;
+        if ((sc->trig_mask & SERVO_SCOPE_TRIG_LATE) && (smp->late > sc->late_limit))
+            cause |= SERVO_SCOPE_TRIG_LATE;
+    }
+
+    if (state == SERVO_SCOPE_FROZEN) {
+        /* Event which happened while the snapshot is written */
+        if (cause)
+            sc->missed++;
+        return;
+    }
+
+    sc->buf[sc->wr % SERVO_SCOPE_LEN] = *smp;
+    sc->wr++;
+
+    if (state == SERVO_SCOPE_ARMED) {
+        if (!cause) {
+            if (sc->filled < sc->pre)
+                sc->filled++;
+            return;
+        }
+        sc->trig_wr = sc->wr - 1;
+        sc->trig_cause = cause;
+        sc->left = sc->post;
+    } else if (sc->left) {
+        sc->left--;
+    }
+
+    if (!sc->left) {
+        __atomic_store_n(&sc->state, SERVO_SCOPE_FROZEN, __ATOMIC_RELEASE);
+        sem_post(&sc->frozen_sem);
+        return;
+    }
+
+    if (state == SERVO_SCOPE_ARMED)
+        __atomic_store_n(&sc->state, SERVO_SCOPE_TRIGGERED, __ATOMIC_RELAXED);
+}
+
+#endif /*_SERVO_SCOPE_H*/
@@ -0,0 +1,62 @@
+/*
+ * POSIX shared memory helpers for rpi_simple_dc_servo
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "servo_shm.h"
+
+void *servo_shm_map(const char *name, size_t size, int create_fl)
+{
+    int fd;
+    void *addr;
+
+    if (name == NULL) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        return addr == MAP_FAILED? NULL: addr;
+    }
+
+    fd = shm_open(name, O_RDWR | (create_fl? O_CREAT: 0), 0660);
+    if (fd == -1)
+        return NULL;
+
+    if (create_fl) {
+        if (ftruncate(fd, size) == -1) {
+            close(fd);
+            return NULL;
+        }
+    } else {
+        struct stat st;
+        /* Object created by other version of the application */
+        if ((fstat(fd, &st) == -1) || (st.st_size < size)) {
+            close(fd);
+            return NULL;
+        }
+    }
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED)
+        return NULL;
+
+    return addr;
+}
+
+void servo_shm_unmap(void *addr, size_t size)
+{
+    if (addr != NULL)
+        munmap(addr, size);
+}
+
+void servo_shm_remove(const char *name)
+{
+    shm_unlink(name);
+}
@@ -0,0 +1,20 @@
+#ifndef _SERVO_SHM_H
+#define _SERVO_SHM_H
+
+#include <stddef.h>
+
+/*
+ * Map POSIX shared memory object into process address space.
+ * When create_fl is set, the object is created (or reused) and
+ * sized to the requested size. NULL name provides anonymous
+ * shared mapping visible only inside the process (and its
+ * children). Returns NULL on failure.
+ */
+void *servo_shm_map(const char *name, size_t size, int create_fl);
+
+void servo_shm_unmap(void *addr, size_t size);
+
+/* Remove named object, existing mappings stay valid */
+void servo_shm_remove(const char *name);
+
+#endif /*_SERVO_SHM_H*/
@@ -0,0 +1,135 @@
+/*
+ * Streaming trajectory input for rpi_simple_dc_servo
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * Underrun is handled deterministically, the last setpoint
+ * is held and the event is counted.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <semaphore.h>
+
+#include "servo_traj.h"
+#include "servo_shm.h"
+
+servo_traj_shm_t *servo_traj_shm_create(uint32_t point_periods)
+{
+    servo_traj_shm_t *shm;
+
+    shm = servo_shm_map(NULL, sizeof(*shm), 1);
+    if (shm == NULL)
+        return NULL;
+
+    memset(shm, 0, sizeof(*shm));
+    shm->point_periods = point_periods? point_periods: 1;
+    if (sem_init(&shm->low_sem, 1, 0) == -1) {
+        servo_shm_unmap(shm, sizeof(*shm));
+        return NULL;
+    }
+
+    __atomic_store_n(&shm->magic, SERVO_TRAJ_MAGIC, __ATOMIC_RELEASE);
+
+    return shm;
+}
+
+static inline uint32_t servo_traj_fill(servo_traj_shm_t *shm)
+{
+    return __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE);
+}
+
+int servo_traj_push(servo_traj_shm_t *shm, const servo_traj_point_t *pt)
+{
+    uint32_t head = shm->head;
+
+    while (servo_traj_fill(shm) >= SERVO_TRAJ_RING_SIZE) {
+        /* Announce waiting first, then recheck to not miss the post */
+        __atomic_store_n(&shm->low_wait, 1, __ATOMIC_SEQ_CST);
+        if (servo_traj_fill(shm) < SERVO_TRAJ_LOW_WATERMARK) {
+            __atomic_store_n(&shm->low_wait, 0, __ATOMIC_RELAXED);
+            break;
+        }
+        if ((sem_wait(&shm->low_sem) == -1) && (errno != EINTR))
+            return -1;
+    }
+
+    shm->ring[head % SERVO_TRAJ_RING_SIZE] = *pt;
+    __atomic_store_n(&shm->head, head + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void servo_traj_finish(servo_traj_shm_t *shm)
+{
+    __atomic_store_n(&shm->eof, 1, __ATOMIC_RELEASE);
+}
+
+int servo_traj_done(servo_traj_shm_t *shm)
+{
+    return __atomic_load_n(&shm->eof, __ATOMIC_ACQUIRE) && !servo_traj_fill(shm);
+}
+
+int servo_traj_next(servo_traj_shm_t *shm, servo_traj_state_t *st,
+                    uint64_t *ref_pos_fract)
+{
+    uint32_t tail;
+    servo_traj_point_t pt;
+    uint32_t point_periods;
+
+    if (st->left) {
+        st->left--;
+        st->pos_fract += st->inc_fract;
+        *ref_pos_fract = st->pos_fract;
+        return 1;
+    }
+
+    tail = shm->tail;
+    if (__atomic_load_n(&shm->head, __ATOMIC_ACQUIRE) == tail) {
+        if (!st->started)
+            return 0;
+        /* Hold the last setpoint */
+        if (!__atomic_load_n(&shm->eof, __ATOMIC_ACQUIRE)) {
+            if (!st->starving)
+                shm->underruns++;
+            shm->underrun_periods++;
+            st->starving = 1;
+        }
+        st->pos_fract = (uint64_t)(uint32_t)st->last.pos << 32;
+        *ref_pos_fract = st->pos_fract;
+        return 1;
+    }
+
+    pt = shm->ring[tail % SERVO_TRAJ_RING_SIZE];
+    __atomic_store_n(&shm->tail, tail + 1, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&shm->head, __ATOMIC_ACQUIRE) - (tail + 1) <
+        SERVO_TRAJ_LOW_WATERMARK) {
+        /* Fill level is below watermark, wake producer if it waits */
+        if (__atomic_exchange_n(&shm->low_wait, 0, __ATOMIC_SEQ_CST))
+            sem_post(&shm->low_sem);
+    }
+
+    st->starving = 0;
+    point_periods = shm->point_periods;
+
+    if (!st->started || (point_periods <= 1)) {
+        st->started = 1;
+        st->pos_fract = (uint64_t)(uint32_t)pt.pos << 32;
+        st->inc_fract = 0;
+        st->left = 0;
+    } else {
+        /* One division per point, interpolation itself is adds only */
+        st->inc_fract = ((int64_t)(int32_t)(pt.pos - st->last.pos) << 32) /
+                        (int64_t)point_periods;
+        st->left = point_periods - 1;
+        st->pos_fract = ((uint64_t)(uint32_t)st->last.pos << 32) + st->inc_fract;
+    }
+
+    st->last = pt;
+    *ref_pos_fract = st->pos_fract;
+
+    return 1;
+}
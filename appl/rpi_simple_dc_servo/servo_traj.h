@@ -0,0 +1,64 @@
+#ifndef _SERVO_TRAJ_H
+#define _SERVO_TRAJ_H
+
+#include <stdint.h>
+#include <semaphore.h>
+
+#define SERVO_TRAJ_MAGIC          0x53544a31
+
+#define SERVO_TRAJ_RING_SIZE      1024  /* power of two */
+#define SERVO_TRAJ_LOW_WATERMARK  256
+
+typedef struct servo_traj_point_t {
+    int32_t pos;   /* position setpoint [IRC counts] */
+} servo_traj_point_t;
+
+/*
+ * Single-producer/single-consumer ring of trajectory points.
+ * The controller consumes one point per point_periods periods
+ * and interpolates linearly in between. When the fill level
+ * drops below low_watermark the waiting producer is woken
+ * through low_sem. The ring is internal to the runtraj process,
+ * the main thread reading the file is the producer.
+ */
+typedef struct servo_traj_shm_t {
+    uint32_t magic;
+    uint32_t point_periods;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t eof;
+    uint32_t underruns;
+    uint32_t underrun_periods;
+    uint32_t low_wait;
+    sem_t    low_sem;
+    servo_traj_point_t ring[SERVO_TRAJ_RING_SIZE];
+} servo_traj_shm_t;
+
+/* Interpolation state private to RT task */
+typedef struct servo_traj_state_t {
+    int      started;
+    int      starving;
+    uint64_t pos_fract;
+    int64_t  inc_fract;
+    uint32_t left;
+    servo_traj_point_t last;
+} servo_traj_state_t;
+
+servo_traj_shm_t *servo_traj_shm_create(uint32_t point_periods);
+
+/* Producer side, blocks while the ring is full */
+int servo_traj_push(servo_traj_shm_t *shm, const servo_traj_point_t *pt);
+
+void servo_traj_finish(servo_traj_shm_t *shm);
+
+/* Producer side, returns 1 when all points have been consumed */
+int servo_traj_done(servo_traj_shm_t *shm);
+
+/*
+ * RT side, computes reference position for the next period.
+ * Returns 0 if the reference has not been updated (no data yet).
+ */
+int servo_traj_next(servo_traj_shm_t *shm, servo_traj_state_t *st,
+                    uint64_t *ref_pos_fract);
+
+#endif /*_SERVO_TRAJ_H*/
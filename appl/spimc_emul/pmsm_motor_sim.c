@@ -0,0 +1,92 @@
+/*
+ * Simulated PMSM motor plant for RPI-MI-1 FPGA emulator
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ *   u_x = supply_voltage * pwm_x / pwm_period, x = a, b, c
+ *   u_alpha = (2 u_a - u_b - u_c) / 3, u_beta = (u_b - u_c) / sqrt(3)
+ *   theta_e = pole_pairs * theta
+ *   L di_alpha/dt = u_alpha - R i_alpha + omega_e flux sin(theta_e)
+ *   L di_beta/dt = u_beta - R i_beta - omega_e flux cos(theta_e)
+ *   T = 3/2 pole_pairs flux (i_beta cos(theta_e) - i_alpha sin(theta_e))
+ *   J domega/dt = T - b omega - Tload
+ *
+ * When the bridge is not switching, the current is commutated
+ * through diodes and it is considered to decay immediately.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "pmsm_motor_sim.h"
+
+void pmsm_motor_sim_init(pmsm_motor_sim_t *sim)
+{
+    memset(sim, 0, sizeof(*sim));
+
+    /* Small 24 V servo motor with 1000 lines encoder */
+    sim->supply_voltage = 24.0;
+    sim->pwm_period = 2048;
+    sim->resistance = 1.0;
+    sim->inductance = 1e-3;
+    sim->flux = 0.01;
+    sim->pole_pairs = 4;
+    sim->inertia = 2e-5;
+    sim->viscous_friction = 1e-5;
+    sim->load_torque = 0;
+    sim->irc_per_rev = 4000;
+}
+
+void pmsm_motor_sim_advance(pmsm_motor_sim_t *sim, double dt)
+{
+    double u_a, u_b, u_c;
+    double u_alpha, u_beta;
+    double theta_e = sim->pole_pairs * sim->theta;
+    double omega_e = sim->pole_pairs * sim->omega;
+    double s = sin(theta_e);
+    double c = cos(theta_e);
+    double torque;
+
+    if (sim->bridge_on) {
+        u_a = sim->supply_voltage * sim->pwm[0] / sim->pwm_period;
+        u_b = sim->supply_voltage * sim->pwm[1] / sim->pwm_period;
+        u_c = sim->supply_voltage * sim->pwm[2] / sim->pwm_period;
+        u_alpha = (2 * u_a - u_b - u_c) / 3;
+        u_beta = (u_b - u_c) / sqrt(3);
+
+        sim->i_alpha += (u_alpha - sim->resistance * sim->i_alpha +
+                         omega_e * sim->flux * s) / sim->inductance * dt;
+        sim->i_beta += (u_beta - sim->resistance * sim->i_beta -
+                        omega_e * sim->flux * c) / sim->inductance * dt;
+    } else {
+        sim->i_alpha = 0;
+        sim->i_beta = 0;
+    }
+
+    torque = 1.5 * sim->pole_pairs * sim->flux *
+             (sim->i_beta * c - sim->i_alpha * s);
+    torque -= sim->viscous_friction * sim->omega + sim->load_torque;
+
+    sim->omega += torque / sim->inertia * dt;
+    sim->theta += sim->omega * dt;
+}
+
+void pmsm_motor_sim_currents(const pmsm_motor_sim_t *sim, double cur[3])
+{
+    cur[0] = sim->i_alpha;
+    cur[1] = -0.5 * sim->i_alpha + sqrt(3) / 2 * sim->i_beta;
+    cur[2] = -0.5 * sim->i_alpha - sqrt(3) / 2 * sim->i_beta;
+}
+
+int32_t pmsm_motor_sim_irc(const pmsm_motor_sim_t *sim)
+{
+    return (int32_t)floor(sim->theta * sim->irc_per_rev / (2 * M_PI));
+}
+
+int pmsm_motor_sim_sector(const pmsm_motor_sim_t *sim)
+{
+    double turns = sim->pole_pairs * sim->theta / (2 * M_PI);
+
+    return (int)floor((turns - floor(turns)) * 6) % 6;
+}
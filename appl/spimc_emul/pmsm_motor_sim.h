@@ -0,0 +1,44 @@
+#ifndef _PMSM_MOTOR_SIM_H
+#define _PMSM_MOTOR_SIM_H
+
+#include <stdint.h>
+
+/*
+ * Continuous model of 3-phase PMSM motor in stator (alpha, beta)
+ * frame with three half-bridge power stage and quadrature
+ * encoder. It is advanced by fixed steps by the FPGA emulator.
+ */
+typedef struct pmsm_motor_sim_t {
+    /* parameters */
+    double supply_voltage;   /* DC link voltage [V] */
+    int    pwm_period;       /* PWM value corresponding to 100% duty */
+    double resistance;       /* phase resistance [Ohm] */
+    double inductance;       /* phase inductance [H] */
+    double flux;             /* permanent magnet flux linkage [Wb] */
+    int    pole_pairs;
+    double inertia;          /* rotor and load inertia [kg m^2] */
+    double viscous_friction; /* [N m s/rad] */
+    double load_torque;      /* external load torque [N m] */
+    double irc_per_rev;      /* encoder counts per revolution (4x decoded) */
+    /* inputs */
+    int    pwm[3];
+    int    bridge_on;        /* all three half-bridges switching */
+    /* state */
+    double i_alpha;
+    double i_beta;
+    double omega;
+    double theta;
+} pmsm_motor_sim_t;
+
+void pmsm_motor_sim_init(pmsm_motor_sim_t *sim);
+
+void pmsm_motor_sim_advance(pmsm_motor_sim_t *sim, double dt);
+
+void pmsm_motor_sim_currents(const pmsm_motor_sim_t *sim, double cur[3]);
+
+int32_t pmsm_motor_sim_irc(const pmsm_motor_sim_t *sim);
+
+/* Electrical sector 0 to 5, sector 0 starts at zero electrical angle */
+int pmsm_motor_sim_sector(const pmsm_motor_sim_t *sim);
+
+#endif /*_PMSM_MOTOR_SIM_H*/
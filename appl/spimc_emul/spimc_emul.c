@@ -0,0 +1,426 @@
+/*
+ * Emulator of RPI-MI-1 FPGA 3-phase motor control design
+ * on spidev interface
+ *
+ * Copyright (C) 2026 rpi-rt-control contributors
+ *
+ * The library is loaded by LD_PRELOAD and it takes over open(),
+ * ioctl() and close() of the SPI device node. SPI_IOC_MESSAGE
+ * frames are decoded and answered by the same frame description
+ * (rpi_spimc_frame.h) which is used by spimc_transfer(). The FPGA
+ * model provides IRC counter with index, hall sensors, ADC sample
+ * sequence counter and 24-bit current sums restarted at each
+ * transfer. PWM outputs drive PMSM motor model which is advanced
+ * by ADC sample period steps.
+ *
+ * Configuration by environment variables:
+ *   SPIMC_EMUL_DEV        emulated device node (/dev/spidev0.1)
+ *   SPIMC_EMUL_PLANT      0 keeps motor still and currents zero
+ *   SPIMC_EMUL_ADC_HZ     ADC sampling rate (200000)
+ *   SPIMC_EMUL_STEP_NS    model time advance per transfer, real time
+ *                         elapsed between transfers is used when zero
+ *   SPIMC_EMUL_SPEED_MAX  fastest SPI clock without bit errors (16 MHz)
+ *   SPIMC_EMUL_WIRE_TIME  1 delays transfers by time on the wire
+ *   SPIMC_EMUL_MSG_NS     delay of each SPI_IOC_MESSAGE modelling
+ *                         syscall and driver setup cost (0)
+ *
+ * The device node can be opened several times, all descriptors
+ * are answered by the same FPGA model.
+ *
+ * The library is built by the host compiler, the application has
+ * to be built by the same one to be preloaded on x86, i.e.
+ *
+ *   make && make -C ../rpi_pmsm_foc CC=gcc
+ *   LD_PRELOAD=./libspimc_emul.so ../rpi_pmsm_foc/rpi_pmsm_foc current 200
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include <linux/spi/spidev.h>
+
+#include "rpi_spimc_frame.h"
+#include "pmsm_motor_sim.h"
+
+#define SPIMC_EMUL_ADC_MAX       4095
+#define SPIMC_EMUL_ADC_GAIN      200.0  /* ADC counts per A */
+#define SPIMC_EMUL_FD_MAX        8
+/* Longer gaps between transfers are not simulated */
+#define SPIMC_EMUL_GAP_MAX_NS    100000000
+
+typedef struct spimc_emul_t {
+    const char *dev;
+    int      fd[SPIMC_EMUL_FD_MAX];
+    int      fd_count;
+    uint8_t  mode;
+    uint8_t  bits;
+    uint32_t speed;
+    /* configuration */
+    int      plant_fl;
+    double   adc_hz;
+    int64_t  step_ns;
+    uint32_t speed_max;
+    int      wire_time_fl;
+    int64_t  msg_ns;
+    int      adc_offs[3];
+    /* FPGA state */
+    pmsm_motor_sim_t sim;
+    double   sample_frac;
+    struct timespec last;
+    int      last_valid;
+    int32_t  irc_rev;
+    uint32_t index_pos;
+    uint32_t adc_sqn;
+    uint32_t adc_sum[3];
+    uint32_t rand_state;
+    unsigned long frames;
+    unsigned long corrupted;
+} spimc_emul_t;
+
+static spimc_emul_t emul = {
+    .dev = "/dev/spidev0.1",
+    .bits = 8,
+    .speed = 500000,
+    .plant_fl = 1,
+    .adc_hz = 200000,
+    .speed_max = 16000000,
+    .adc_offs = {2072, 2077, 2051},
+    .rand_state = 0x2545f491,
+};
+
+static pthread_mutex_t emul_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int (*real_open)(const char *path, int flags, ...);
+static int (*real_open64)(const char *path, int flags, ...);
+static int (*real_close)(int fd);
+static int (*real_ioctl)(int fd, unsigned long request, ...);
+
+/* Inverse of pxmc_lpc_bdc_hal_pos_table used by S-functions */
+static const uint8_t spimc_emul_hal_code[6] = {1, 5, 4, 6, 2, 3};
+
+static const char *emul_env(const char *name, const char *dflt)
+{
+    const char *s = getenv(name);
+
+    return (s != NULL) && *s? s: dflt;
+}
+
+__attribute__((constructor))
+static void spimc_emul_setup(void)
+{
+    real_open = dlsym(RTLD_NEXT, "open");
+    real_open64 = dlsym(RTLD_NEXT, "open64");
+    real_close = dlsym(RTLD_NEXT, "close");
+    real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+
+    emul.dev = emul_env("SPIMC_EMUL_DEV", emul.dev);
+    emul.plant_fl = atoi(emul_env("SPIMC_EMUL_PLANT", "1"));
+    emul.adc_hz = atof(emul_env("SPIMC_EMUL_ADC_HZ", "200000"));
+    emul.step_ns = atoll(emul_env("SPIMC_EMUL_STEP_NS", "0"));
+    emul.speed_max = strtoul(emul_env("SPIMC_EMUL_SPEED_MAX", "16000000"), NULL, 0);
+    emul.wire_time_fl = atoi(emul_env("SPIMC_EMUL_WIRE_TIME", "0"));
+    emul.msg_ns = atoll(emul_env("SPIMC_EMUL_MSG_NS", "0"));
+    if (emul.adc_hz <= 0)
+        emul.adc_hz = 200000;
+
+    pmsm_motor_sim_init(&emul.sim);
+}
+
+__attribute__((destructor))
+static void spimc_emul_report(void)
+{
+    if (emul.frames)
+        fprintf(stderr, "spimc_emul: %lu frames, %lu corrupted, %.1f rev\n",
+                emul.frames, emul.corrupted, emul.sim.theta / (2 * M_PI));
+}
+
+static inline uint32_t emul_rand(void)
+{
+    uint32_t x = emul.rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    emul.rand_state = x;
+    return x;
+}
+
+static inline int64_t timespec_diff_nsec(const struct timespec *a,
+                                         const struct timespec *b)
+{
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 +
+           (a->tv_nsec - b->tv_nsec);
+}
+
+/* One ADC sample period of the FPGA and motor */
+static void emul_sample(void)
+{
+    double cur[3] = {0, 0, 0};
+    int32_t irc;
+    int32_t rev;
+    int adc;
+    int i;
+
+    if (emul.plant_fl) {
+        pmsm_motor_sim_advance(&emul.sim, 1.0 / emul.adc_hz);
+        pmsm_motor_sim_currents(&emul.sim, cur);
+    }
+
+    /* index mark is at zero position of each revolution */
+    irc = pmsm_motor_sim_irc(&emul.sim);
+    rev = (int32_t)floor(irc / emul.sim.irc_per_rev);
+    if (rev != emul.irc_rev) {
+        emul.index_pos = (rev > emul.irc_rev? rev: emul.irc_rev) *
+                         (int32_t)emul.sim.irc_per_rev;
+        emul.irc_rev = rev;
+    }
+
+    for (i = 0; i < 3; i++) {
+        adc = emul.adc_offs[i] + (int)lround(cur[i] * SPIMC_EMUL_ADC_GAIN);
+        if (adc < 0)
+            adc = 0;
+        if (adc > SPIMC_EMUL_ADC_MAX)
+            adc = SPIMC_EMUL_ADC_MAX;
+        emul.adc_sum[i] += adc;
+    }
+    emul.adc_sqn++;
+}
+
+static void emul_advance(void)
+{
+    struct timespec now;
+    int64_t nsec;
+    double samples;
+
+    if (emul.step_ns) {
+        nsec = emul.step_ns;
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        nsec = emul.last_valid? timespec_diff_nsec(&now, &emul.last): 0;
+        emul.last = now;
+        emul.last_valid = 1;
+    }
+    if (nsec > SPIMC_EMUL_GAP_MAX_NS)
+        nsec = SPIMC_EMUL_GAP_MAX_NS;
+
+    samples = nsec * 1e-9 * emul.adc_hz + emul.sample_frac;
+    emul.sample_frac = samples - floor(samples);
+    while (samples >= 1) {
+        emul_sample();
+        samples -= 1;
+    }
+}
+
+static void emul_frame(uint8_t *rx, const uint8_t *tx, uint32_t speed)
+{
+    spimc_tx_frame_t txf;
+    spimc_rx_frame_t rxf;
+    int code;
+    int i;
+
+    emul_advance();
+
+    code = spimc_emul_hal_code[pmsm_motor_sim_sector(&emul.sim)];
+    rxf.irc_pos = pmsm_motor_sim_irc(&emul.sim);
+    rxf.hal1 = code & 1;
+    rxf.hal2 = (code >> 1) & 1;
+    rxf.hal3 = (code >> 2) & 1;
+    rxf.index_pos = emul.index_pos;
+    rxf.adc_sqn = emul.adc_sqn;
+    rxf.adc_sum0 = emul.adc_sum[0];
+    rxf.adc_sum1 = emul.adc_sum[1];
+    rxf.adc_sum2 = emul.adc_sum[2];
+    if (rx != NULL)
+        spimc_rx_frame_pack(rx, &rxf);
+
+    emul.adc_sqn = 0;
+    for (i = 0; i < 3; i++)
+        emul.adc_sum[i] = 0;
+
+    if (tx != NULL) {
+        spimc_tx_frame_unpack(&txf, tx);
+        emul.sim.pwm[0] = txf.pwm1;
+        emul.sim.pwm[1] = txf.pwm2;
+        emul.sim.pwm[2] = txf.pwm3;
+        emul.sim.bridge_on = txf.pwm1_en && txf.pwm2_en && txf.pwm3_en &&
+                             !txf.pwm1_shdn && !txf.pwm2_shdn && !txf.pwm3_shdn;
+    }
+
+    /* signal integrity is lost above the link limit */
+    if ((rx != NULL) && (speed > emul.speed_max) && !(emul_rand() & 3)) {
+        i = emul_rand() % (SPIMC_FRAME_SIZE * 8);
+        rx[i / 8] ^= 0x80 >> (i % 8);
+        emul.corrupted++;
+    }
+
+    emul.frames++;
+}
+
+static void emul_busy_wait(int64_t nsec)
+{
+    struct timespec t0, t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do
+        clock_gettime(CLOCK_MONOTONIC, &t);
+    while (timespec_diff_nsec(&t, &t0) < nsec);
+}
+
+static int emul_message(struct spi_ioc_transfer *tr, unsigned n)
+{
+    uint32_t speed;
+    int ret = 0;
+    unsigned k;
+
+    pthread_mutex_lock(&emul_lock);
+    if (emul.msg_ns)
+        emul_busy_wait(emul.msg_ns);
+    for (k = 0; k < n; k++) {
+        speed = tr[k].speed_hz && (tr[k].speed_hz < emul.speed)?
+                tr[k].speed_hz: emul.speed;
+        if (tr[k].len == SPIMC_FRAME_SIZE) {
+            emul_frame((uint8_t *)(uintptr_t)tr[k].rx_buf,
+                       (const uint8_t *)(uintptr_t)tr[k].tx_buf, speed);
+        } else if (tr[k].rx_buf) {
+            memset((void *)(uintptr_t)tr[k].rx_buf, 0, tr[k].len);
+        }
+        if (emul.wire_time_fl)
+            emul_busy_wait((int64_t)tr[k].len * 8 * 1000000000 / (speed? speed: 1));
+        ret += tr[k].len;
+    }
+    pthread_mutex_unlock(&emul_lock);
+
+    return ret;
+}
+
+static int emul_open(const char *path, int flags)
+{
+    int fd;
+
+    fd = real_open("/dev/null", O_RDWR);
+    if (fd < 0)
+        return fd;
+
+    pthread_mutex_lock(&emul_lock);
+    if (emul.fd_count >= SPIMC_EMUL_FD_MAX) {
+        pthread_mutex_unlock(&emul_lock);
+        real_close(fd);
+        return -1;
+    }
+    emul.fd[emul.fd_count++] = fd;
+    emul.last_valid = 0;
+    emul.irc_rev = (int32_t)floor(pmsm_motor_sim_irc(&emul.sim) /
+                                  emul.sim.irc_per_rev);
+    pthread_mutex_unlock(&emul_lock);
+
+    fprintf(stderr, "spimc_emul: %s emulated, plant %s\n", path,
+            emul.plant_fl? "on": "off");
+
+    return fd;
+}
+
+int open(const char *path, int flags, ...)
+{
+    va_list ap;
+    mode_t mode = 0;
+
+    if (!strcmp(path, emul.dev))
+        return emul_open(path, flags);
+
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+    return real_open(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+    va_list ap;
+    mode_t mode = 0;
+
+    if (!strcmp(path, emul.dev))
+        return emul_open(path, flags);
+
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+    return (real_open64? real_open64: real_open)(path, flags, mode);
+}
+
+static int emul_fd_find(int fd)
+{
+    int i;
+
+    for (i = 0; i < emul.fd_count; i++)
+        if (emul.fd[i] == fd)
+            return i;
+    return -1;
+}
+
+int close(int fd)
+{
+    int i;
+
+    pthread_mutex_lock(&emul_lock);
+    i = emul_fd_find(fd);
+    if (i >= 0)
+        emul.fd[i] = emul.fd[--emul.fd_count];
+    pthread_mutex_unlock(&emul_lock);
+
+    return real_close(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    void *arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if ((fd < 0) || (emul_fd_find(fd) < 0))
+        return real_ioctl(fd, request, arg);
+
+    switch (request) {
+        case SPI_IOC_WR_MODE:
+            emul.mode = *(uint8_t *)arg;
+            return 0;
+        case SPI_IOC_RD_MODE:
+            *(uint8_t *)arg = emul.mode;
+            return 0;
+        case SPI_IOC_WR_BITS_PER_WORD:
+            emul.bits = *(uint8_t *)arg;
+            return 0;
+        case SPI_IOC_RD_BITS_PER_WORD:
+            *(uint8_t *)arg = emul.bits;
+            return 0;
+        case SPI_IOC_WR_MAX_SPEED_HZ:
+            emul.speed = *(uint32_t *)arg;
+            return 0;
+        case SPI_IOC_RD_MAX_SPEED_HZ:
+            *(uint32_t *)arg = emul.speed;
+            return 0;
+    }
+
+    if ((_IOC_TYPE(request) == SPI_IOC_MAGIC) && (_IOC_NR(request) == 0) &&
+        (_IOC_DIR(request) == _IOC_WRITE))
+        return emul_message(arg, _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer));
+
+    return real_ioctl(fd, request, arg);
+}
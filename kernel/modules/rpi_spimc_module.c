@@ -0,0 +1,534 @@
+/*
+ *  file: rpi_spimc_module.c
+ *
+ *  Driver running periodic SPI exchange with RPI-MI-1 FPGA
+ *  3-phase motor control design from kernel timer
+ *
+ *  Copyright (C) 2026 rpi-rt-control contributors
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License.  See the file COPYING in the main directory of this archive
+ *  for more details.
+ */
+
+/*
+The driver creates its own SPI device on given bus and chip select
+(the spidev instance for the same chip select has to be unbound
+first). The 16-byte frame is started by spi_async() from hrtimer
+each period. The message is prepared once, the timer callback only
+packs the latest PWM command into TX buffer and completion callback
+unpacks RX buffer to the feedback slot of the page mapped by
+userspace (see rpi_spimc_module.h). The control task does not need
+any syscall in its loop, read() of /dev/spimc0 can be used to block
+until the next frame is received.
+
+The exchange runs while the device is open. PWM outputs are shut
+down when the last user closes the device or when commands have not
+been updated for watchdog_periods periods.
+
+The timer expires in hard interrupt context where the kernel allows
+it. spi_async() takes controller queue locks which sleep on PREEMPT_RT,
+so there the timer is left in soft mode and the callback runs in the
+ktimers (ksoftirqd on older RT kernels) thread. The frame itself is
+always clocked out by the controller message pump thread (spi0). Both
+threads have to be given SCHED_FIFO priority above the control task,
+e.g. chrt -f -p 85 for each of them, otherwise the period jitters with
+the load of the system.
+*/
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/spi/spi.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/version.h>
+
+#include "rpi_spimc_frame.h"
+#include "rpi_spimc_module.h"
+
+/* PWM word encoding of simulink/rpi_spimc.h */
+#define SPIMC_PWM_VALUE_m	0x0ffff
+#define SPIMC_PWM_ENABLE	0x10000
+#define SPIMC_PWM_SHUTDOWN	0x20000
+#define SPIMC_PWM_MAX		2047
+
+#define DEVICE_NAME	"spimc"
+
+#if defined(CONFIG_PREEMPT_RT) || defined(CONFIG_PREEMPT_RT_FULL) || \
+    (LINUX_VERSION_CODE < KERNEL_VERSION(5, 4, 0))
+#define SPIMC_HRTIMER_MODE	HRTIMER_MODE_REL
+#else
+#define SPIMC_HRTIMER_MODE	HRTIMER_MODE_REL_HARD
+#endif
+
+static int bus_num;
+module_param(bus_num, int, 0444);
+MODULE_PARM_DESC(bus_num, "SPI bus number (0)");
+
+static int chip_select = 1;
+module_param(chip_select, int, 0444);
+MODULE_PARM_DESC(chip_select, "SPI chip select (1)");
+
+static int speed_hz = 4000000;
+module_param(speed_hz, int, 0444);
+MODULE_PARM_DESC(speed_hz, "SPI clock (4000000)");
+
+static int period_usec = 50;
+module_param(period_usec, int, 0444);
+MODULE_PARM_DESC(period_usec, "exchange period in microseconds (50)");
+
+static int watchdog_periods = 1000;
+module_param(watchdog_periods, int, 0444);
+MODULE_PARM_DESC(watchdog_periods, "shut PWM down when commands are not updated (1000, 0 disables)");
+
+struct spimc_kstate {
+	struct mutex lock;	/* serializes start and stop */
+	int used_count;
+	struct spi_device *spi;
+	struct rpi_spimc_shm *shm;
+	struct hrtimer timer;
+	ktime_t period;
+	struct spi_message msg;
+	struct spi_transfer xfer;
+	uint8_t tx_buf[SPIMC_FRAME_SIZE] ____cacheline_aligned;
+	uint8_t rx_buf[SPIMC_FRAME_SIZE] ____cacheline_aligned;
+	uint32_t pwm[RPI_SPIMC_CHAN_COUNT];
+	uint32_t cmd_idx;
+	uint32_t cmd_seq;
+	uint32_t cmd_idle;
+	uint32_t frame;
+	atomic_t busy;
+	int running;
+	wait_queue_head_t idle_wq;
+	wait_queue_head_t frame_wq;
+};
+
+struct spimc_kstate spimc_kstate_0;
+
+int dev_major;
+
+static struct class *spimc_class;
+
+/*
+ * spimc_cmd_fetch:
+ *	take the published command slot unless userspace updates it just now
+ */
+static void spimc_cmd_fetch(struct spimc_kstate *st)
+{
+	struct rpi_spimc_shm *shm = st->shm;
+	uint32_t idx = READ_ONCE(shm->cmd_idx) & 1;
+	struct rpi_spimc_cmd *slot = &shm->cmd[idx];
+	uint32_t pwm[RPI_SPIMC_CHAN_COUNT];
+	uint32_t seq;
+	int i;
+
+	seq = READ_ONCE(slot->seq);
+	smp_rmb();
+	if (seq & 1)
+		return;
+	for (i = 0; i < RPI_SPIMC_CHAN_COUNT; i++)
+		pwm[i] = READ_ONCE(slot->pwm[i]);
+	smp_rmb();
+	if (READ_ONCE(slot->seq) != seq)
+		return;
+
+	/*
+	 * Slots alternate and each counts 2, 4, 6..., only the pair
+	 * (idx, seq) changes with every publish
+	 */
+	if ((idx != st->cmd_idx) || (seq != st->cmd_seq)) {
+		st->cmd_idx = idx;
+		st->cmd_seq = seq;
+		st->cmd_idle = 0;
+	} else if (watchdog_periods && (st->cmd_idle < watchdog_periods)) {
+		if (++st->cmd_idle == watchdog_periods)
+			shm->watchdog_trips++;
+	}
+
+	if (watchdog_periods && (st->cmd_idle >= watchdog_periods)) {
+		for (i = 0; i < RPI_SPIMC_CHAN_COUNT; i++)
+			st->pwm[i] = SPIMC_PWM_SHUTDOWN;
+		return;
+	}
+
+	memcpy(st->pwm, pwm, sizeof(pwm));
+}
+
+/* The same mapping of PWM words to TX fields as spimc_transfer() */
+static void spimc_tx_prepare(struct spimc_kstate *st)
+{
+	spimc_tx_frame_t txf;
+	uint32_t val[RPI_SPIMC_CHAN_COUNT];
+	int i;
+
+	for (i = 0; i < RPI_SPIMC_CHAN_COUNT; i++) {
+		val[i] = st->pwm[i] & SPIMC_PWM_VALUE_m;
+		if (val[i] > SPIMC_PWM_MAX)
+			val[i] = SPIMC_PWM_MAX;
+	}
+
+	txf.adc_reset = 0;
+	txf.pwm1_en = (st->pwm[0] & SPIMC_PWM_ENABLE) ? 1 : 0;
+	txf.pwm2_en = (st->pwm[1] & SPIMC_PWM_ENABLE) ? 1 : 0;
+	txf.pwm3_en = (st->pwm[2] & SPIMC_PWM_ENABLE) ? 1 : 0;
+	txf.pwm1_shdn = (st->pwm[0] & SPIMC_PWM_SHUTDOWN) ? 1 : 0;
+	txf.pwm2_shdn = (st->pwm[1] & SPIMC_PWM_SHUTDOWN) ? 1 : 0;
+	txf.pwm3_shdn = (st->pwm[2] & SPIMC_PWM_SHUTDOWN) ? 1 : 0;
+	txf.pwm1 = val[0];
+	txf.pwm2 = val[1];
+	txf.pwm3 = val[2];
+
+	spimc_tx_frame_pack(st->tx_buf, &txf);
+}
+
+/*
+ * spimc_fb_publish:
+ *	decode received frame to the unpublished slot and switch to it
+ */
+static void spimc_fb_publish(struct spimc_kstate *st)
+{
+	struct rpi_spimc_shm *shm = st->shm;
+	uint32_t idx = (shm->fb_idx & 1) ^ 1;
+	struct rpi_spimc_fb *slot = &shm->fb[idx];
+	spimc_rx_frame_t rxf;
+
+	spimc_rx_frame_unpack(&rxf, st->rx_buf);
+
+	WRITE_ONCE(slot->seq, slot->seq + 1);
+	smp_wmb();
+	slot->frame = ++st->frame;
+	slot->time_ns = ktime_get_ns();
+	slot->irc_pos = rxf.irc_pos;
+	slot->index_pos = rxf.index_pos;
+	slot->hal_sensors = rxf.hal1 | (rxf.hal2 << 1) | (rxf.hal3 << 2);
+	slot->adc_sqn = rxf.adc_sqn;
+	slot->adc_sum[0] = rxf.adc_sum0;
+	slot->adc_sum[1] = rxf.adc_sum1;
+	slot->adc_sum[2] = rxf.adc_sum2;
+	smp_wmb();
+	WRITE_ONCE(slot->seq, slot->seq + 1);
+	smp_wmb();
+	WRITE_ONCE(shm->fb_idx, idx);
+}
+
+/*
+ * spimc_complete:
+ *	SPI message completion, may be called from interrupt context
+ */
+static void spimc_complete(void *context)
+{
+	struct spimc_kstate *st = context;
+
+	if (st->msg.status == 0)
+		spimc_fb_publish(st);
+	else
+		st->shm->spi_errors++;
+
+	atomic_set(&st->busy, 0);
+	wake_up(&st->idle_wq);
+	wake_up_interruptible(&st->frame_wq);
+}
+
+static enum hrtimer_restart spimc_timer_fn(struct hrtimer *timer)
+{
+	struct spimc_kstate *st = container_of(timer, struct spimc_kstate, timer);
+
+	hrtimer_forward_now(timer, st->period);
+
+	if (!st->running)
+		return HRTIMER_NORESTART;
+
+	if (atomic_cmpxchg(&st->busy, 0, 1) != 0) {
+		st->shm->overruns++;
+		return HRTIMER_RESTART;
+	}
+
+	spimc_cmd_fetch(st);
+	spimc_tx_prepare(st);
+
+	if (spi_async(st->spi, &st->msg) != 0) {
+		st->shm->spi_errors++;
+		atomic_set(&st->busy, 0);
+	}
+
+	return HRTIMER_RESTART;
+}
+
+static void spimc_start(struct spimc_kstate *st)
+{
+	int i;
+
+	for (i = 0; i < RPI_SPIMC_CHAN_COUNT; i++) {
+		st->pwm[i] = SPIMC_PWM_SHUTDOWN;
+		st->shm->cmd[0].pwm[i] = SPIMC_PWM_SHUTDOWN;
+		st->shm->cmd[1].pwm[i] = SPIMC_PWM_SHUTDOWN;
+	}
+	st->cmd_idle = 0;
+	/* spi_sync() of the shutdown frame replaces completion */
+	st->msg.complete = spimc_complete;
+	st->msg.context = st;
+	st->running = 1;
+	hrtimer_start(&st->timer, st->period, SPIMC_HRTIMER_MODE);
+}
+
+/*
+ * spimc_stop:
+ *	stop the timer, wait for the frame in flight and send shutdown frame
+ */
+static void spimc_stop(struct spimc_kstate *st)
+{
+	int i;
+
+	st->running = 0;
+	hrtimer_cancel(&st->timer);
+	wait_event(st->idle_wq, atomic_read(&st->busy) == 0);
+
+	for (i = 0; i < RPI_SPIMC_CHAN_COUNT; i++)
+		st->pwm[i] = SPIMC_PWM_SHUTDOWN;
+	spimc_tx_prepare(st);
+	if (spi_sync(st->spi, &st->msg) != 0)
+		pr_err("spimc: PWM shutdown frame failed\n");
+}
+
+/*
+ * spimc_read:
+ *	wait for the next frame and return its feedback record
+ */
+ssize_t spimc_read(struct file *file, char *buffer, size_t length, loff_t *offset)
+{
+	struct spimc_kstate *st = (struct spimc_kstate *)file->private_data;
+	struct rpi_spimc_shm *shm = st->shm;
+	struct rpi_spimc_fb *slot;
+	struct rpi_spimc_fb fb;
+	uint32_t frame = READ_ONCE(st->frame);
+	uint32_t seq;
+	int ret;
+
+	if (length < sizeof(fb))
+		return -EINVAL;
+
+	ret = wait_event_interruptible(st->frame_wq, READ_ONCE(st->frame) != frame);
+	if (ret)
+		return ret;
+
+	/* Next frame can complete meanwhile, same retry as rpi_spimc_shm_get_fb() */
+	do {
+		slot = &shm->fb[READ_ONCE(shm->fb_idx) & 1];
+		smp_rmb();
+		seq = READ_ONCE(slot->seq);
+		smp_rmb();
+		fb = *slot;
+		smp_rmb();
+	} while ((seq & 1) || (READ_ONCE(slot->seq) != seq));
+
+	if (copy_to_user(buffer, &fb, sizeof(fb)))
+		return -EFAULT;
+
+	return sizeof(fb);
+}
+
+/*
+ * spimc_mmap:
+ *	map the shared page, only single page at offset zero is provided
+ */
+int spimc_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct spimc_kstate *st = (struct spimc_kstate *)file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+
+	if ((vma->vm_pgoff != 0) || (size > PAGE_SIZE))
+		return -EINVAL;
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       virt_to_phys(st->shm) >> PAGE_SHIFT,
+			       size, vma->vm_page_prot);
+}
+
+/*
+ * spimc_open:
+ *	the first user starts periodic exchange
+ */
+int spimc_open(struct inode *inode, struct file *file)
+{
+	int dev_minor = MINOR(inode->i_rdev);
+	struct spimc_kstate *st = &spimc_kstate_0;
+
+	if (dev_minor > 0)
+		return -ENODEV;
+
+	mutex_lock(&st->lock);
+	if (st->used_count++ == 0)
+		spimc_start(st);
+	mutex_unlock(&st->lock);
+
+	file->private_data = st;
+	return 0;
+}
+
+/*
+ * spimc_release:
+ *	the last user stops exchange and shuts PWM down
+ */
+int spimc_release(struct inode *inode, struct file *file)
+{
+	struct spimc_kstate *st = (struct spimc_kstate *)file->private_data;
+
+	mutex_lock(&st->lock);
+	if (--st->used_count == 0)
+		spimc_stop(st);
+	mutex_unlock(&st->lock);
+
+	return 0;
+}
+
+const struct file_operations spimc_fops = {
+	.owner = THIS_MODULE,
+	.read = spimc_read,
+	.mmap = spimc_mmap,
+	.open = spimc_open,
+	.release = spimc_release,
+};
+
+/*
+ * spimc_setup_spi:
+ *	create SPI device on requested bus and chip select
+ */
+int spimc_setup_spi(struct spimc_kstate *st)
+{
+	struct spi_master *master;
+	struct spi_board_info info = {
+		.modalias = "rpi-spimc",
+		.mode = SPI_MODE_0,
+	};
+
+	info.bus_num = bus_num;
+	info.chip_select = chip_select;
+	info.max_speed_hz = speed_hz;
+
+	master = spi_busnum_to_master(bus_num);
+	if (master == NULL) {
+		pr_err("spimc: SPI bus %d not found\n", bus_num);
+		return -ENODEV;
+	}
+	st->spi = spi_new_device(master, &info);
+	put_device(&master->dev);
+	if (st->spi == NULL) {
+		pr_err("spimc: cannot create device on SPI %d.%d, unbind spidev\n",
+		       bus_num, chip_select);
+		return -EBUSY;
+	}
+
+	st->spi->bits_per_word = 8;
+	if (spi_setup(st->spi) != 0) {
+		spi_unregister_device(st->spi);
+		return -EIO;
+	}
+
+	/* Prepared once, only buffer contents change */
+	memset(&st->xfer, 0, sizeof(st->xfer));
+	st->xfer.tx_buf = st->tx_buf;
+	st->xfer.rx_buf = st->rx_buf;
+	st->xfer.len = SPIMC_FRAME_SIZE;
+	st->xfer.speed_hz = speed_hz;
+	spi_message_init_with_transfers(&st->msg, &st->xfer, 1);
+
+	return 0;
+}
+
+/*
+ * spimc_init:
+ *	Module initialization.
+ */
+static int spimc_init(void)
+{
+	int res;
+	int dev_minor = 0;
+	struct spimc_kstate *st = &spimc_kstate_0;
+	struct device *this_dev;
+
+	BUILD_BUG_ON(sizeof(struct rpi_spimc_shm) > PAGE_SIZE);
+
+	if ((period_usec <= 0) || (speed_hz <= 0))
+		return -EINVAL;
+
+	st->shm = (struct rpi_spimc_shm *)get_zeroed_page(GFP_KERNEL);
+	if (st->shm == NULL)
+		return -ENOMEM;
+	SetPageReserved(virt_to_page(st->shm));
+	st->shm->period_ns = period_usec * 1000;
+	st->period = ns_to_ktime(st->shm->period_ns);
+
+	mutex_init(&st->lock);
+	init_waitqueue_head(&st->idle_wq);
+	init_waitqueue_head(&st->frame_wq);
+	hrtimer_init(&st->timer, CLOCK_MONOTONIC, SPIMC_HRTIMER_MODE);
+	st->timer.function = spimc_timer_fn;
+
+	res = spimc_setup_spi(st);
+	if (res < 0)
+		goto error_spi;
+
+	spimc_class = class_create(THIS_MODULE, DEVICE_NAME);
+	res = register_chrdev(dev_major, DEVICE_NAME, &spimc_fops);
+	if (res < 0) {
+		pr_err("spimc: error registering driver\n");
+		goto error_chrdev;
+	}
+	if (dev_major == 0)
+		dev_major = res;
+
+	this_dev = device_create(spimc_class, NULL, MKDEV(dev_major, dev_minor),
+				 NULL, "spimc%d", dev_minor);
+	if (IS_ERR(this_dev)) {
+		pr_err("spimc: problem to create device \"spimc%d\"\n", dev_minor);
+		res = PTR_ERR(this_dev);
+		goto error_device;
+	}
+
+	pr_notice("spimc: SPI %d.%d at %d Hz, period %d us\n",
+		  bus_num, chip_select, speed_hz, period_usec);
+	return 0;
+
+error_device:
+	unregister_chrdev(dev_major, DEVICE_NAME);
+error_chrdev:
+	class_destroy(spimc_class);
+	spi_unregister_device(st->spi);
+error_spi:
+	ClearPageReserved(virt_to_page(st->shm));
+	free_page((unsigned long)st->shm);
+	return res;
+}
+
+/*
+ * spimc_exit:
+ *	Called when module is removed.
+ */
+static void spimc_exit(void)
+{
+	struct spimc_kstate *st = &spimc_kstate_0;
+	int dev_minor = 0;
+
+	device_destroy(spimc_class, MKDEV(dev_major, dev_minor));
+	class_destroy(spimc_class);
+	unregister_chrdev(dev_major, DEVICE_NAME);
+	spi_unregister_device(st->spi);
+	ClearPageReserved(virt_to_page(st->shm));
+	free_page((unsigned long)st->shm);
+
+	pr_notice("spimc: module closed\n");
+}
+
+module_init(spimc_init);
+module_exit(spimc_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_VERSION("1.0");
+MODULE_DESCRIPTION("periodic SPI exchange with RPI-MI-1 motor control FPGA");
+MODULE_AUTHOR("rpi-rt-control contributors");
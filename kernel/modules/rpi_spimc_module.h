@@ -0,0 +1,99 @@
+/*
+ *  file: rpi_spimc_module.h
+ *
+ *  Layout of the page shared by rpi_spimc_module with userspace
+ *  through mmap() of /dev/spimc0
+ *
+ *  Copyright (C) 2026 rpi-rt-control contributors
+ *
+ *  This file is subject to the terms and conditions of the GNU General Public
+ *  License.  See the file COPYING in the main directory of this archive
+ *  for more details.
+ */
+
+/*
+Commands and feedback are double buffered. The writer fills the slot
+which is not published, its seq is odd during the update, and then
+the slot index is switched. The reader copies the published slot and
+retries when seq has been odd or changed meanwhile. Neither side
+waits for the other, the kernel keeps the last command when it meets
+a slot in the middle of update.
+*/
+
+#ifndef _RPI_SPIMC_MODULE_H
+#define _RPI_SPIMC_MODULE_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#define RPI_SPIMC_CHAN_COUNT	3
+
+/* PWM words use SPIMC_PWM_* encoding of simulink/rpi_spimc.h */
+struct rpi_spimc_cmd {
+	uint32_t seq;
+	uint32_t pwm[RPI_SPIMC_CHAN_COUNT];
+};
+
+/* Raw fields of the last received frame, sums restart at each frame */
+struct rpi_spimc_fb {
+	uint32_t seq;
+	uint32_t frame;		/* received frames counter */
+	uint64_t time_ns;	/* CLOCK_MONOTONIC at frame completion */
+	uint32_t irc_pos;
+	uint32_t index_pos;	/* 12 LSB of position at last index */
+	uint32_t hal_sensors;
+	uint32_t adc_sqn;
+	uint32_t adc_sum[RPI_SPIMC_CHAN_COUNT];
+};
+
+struct rpi_spimc_shm {
+	uint32_t cmd_idx;	/* written by userspace */
+	uint32_t fb_idx;	/* written by kernel */
+	struct rpi_spimc_cmd cmd[2];
+	struct rpi_spimc_fb fb[2];
+	uint32_t period_ns;
+	uint32_t overruns;	/* periods skipped, previous frame in flight */
+	uint32_t spi_errors;
+	uint32_t watchdog_trips;
+};
+
+#ifndef __KERNEL__
+
+/* Returns frame counter of the copied feedback */
+static inline uint32_t rpi_spimc_shm_get_fb(volatile struct rpi_spimc_shm *shm,
+					     struct rpi_spimc_fb *fb)
+{
+	volatile struct rpi_spimc_fb *slot;
+	uint32_t seq;
+
+	do {
+		slot = &shm->fb[__atomic_load_n(&shm->fb_idx, __ATOMIC_ACQUIRE) & 1];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		*fb = *(struct rpi_spimc_fb *)slot;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || (seq != slot->seq));
+
+	return fb->frame;
+}
+
+static inline void rpi_spimc_shm_put_cmd(volatile struct rpi_spimc_shm *shm,
+					 const uint32_t pwm[RPI_SPIMC_CHAN_COUNT])
+{
+	uint32_t idx = (shm->cmd_idx & 1) ^ 1;
+	volatile struct rpi_spimc_cmd *slot = &shm->cmd[idx];
+	int i;
+
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (i = 0; i < RPI_SPIMC_CHAN_COUNT; i++)
+		slot->pwm[i] = pwm[i];
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm->cmd_idx, idx, __ATOMIC_RELEASE);
+}
+
+#endif /*__KERNEL__*/
+
+#endif /*_RPI_SPIMC_MODULE_H*/
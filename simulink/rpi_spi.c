@@ -10,24 +10,41 @@
 
 #include <stdint.h>
 #include <unistd.h>
+#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
 #include <sys/ioctl.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 
 #include "rpi_spimc.h"
+#include "rpi_spimc_frame.h"
 
 #define SPIMC_INDEX_BITS 12
 #define SPIMC_INDEX_MASK ((1 << SPIMC_INDEX_BITS) - 1)
 
-static uint8_t spimc_mode = 0;
-static uint8_t spimc_bits = 8;
-static uint32_t spimc_speed = 500000;
-static uint16_t spimc_delay = 0;
+/* Speed is increased by this factor (in percent) in each training step */
+#define SPIMC_TRAIN_STEP_PCT  125
+/* Position change tolerated between reference and tested frames */
+#define SPIMC_TRAIN_POS_TOL   16
+/*
+ * Isolated mismatches are tolerated, ADC sequence counter wraps
+ * when the task is preempted between reference and tested frame
+ */
+#define SPIMC_TRAIN_FAIL_MAX  1
+#define SPIMC_CURADC_MAX      4095
+
+/*
+ * Reciprocals of ADC sample counts, 2^32 / sqn rounded up,
+ * replace division when averaging accumulated currents.
+ */
+static uint32_t spimc_curadc_recip[SPIMC_CURADC_SQN_MAX + 1];
 
 static void pabort(const char *s)
 {
@@ -35,145 +52,82 @@ static void pabort(const char *s)
         abort();
 }
 
-int spimc_transfer(spimc_state_t *spimcst)
+/* Fill TX buffer from requested PWM state */
+static void spimc_frame_prepare(spimc_state_t *spimcst)
 {
-	uint8_t *tx = spimcst->tx_buf;
-	uint8_t *rx = spimcst->rx_buf;
-	int ret;
+	spimc_tx_frame_t txf;
 	uint32_t pwm1, pwm2, pwm3;
-	uint32_t idx;
-	int32_t  idxdiff;
-
-	memset(tx, 0, SPIMC_TRANSFER_SIZE);
-	memset(rx, 0, SPIMC_TRANSFER_SIZE);
-
-	/*Data format:
-	 * rx[0] - bity 127 downto 120 the first income bit..127
-	 * rx[1] - bity 119 downto 112
-	 * rx[2] - bity 111 downto 104
-	 * rx[3] - bity 103 downto 96
-	 * tx[4] - bity 95 downto 88
-	 * tx[5] - bity 87 downto 80
-	 * tx[6] - bity 79 downto 72
-	 * tx[7] - bity 71 downto 64
-	 * tx[8] - bity 63 downto 56
-	 * tx[9] - bity 55 downto 48
-	 * tx[10] - bity 47 downto 40
-	 * tx[11] - bity 39 downto 32
-	 * tx[12] - bity 31 downto 24
-	 * tx[13] - bity 23 downto 16
-	 * tx[14] - bity 15 downto 8
-	 * tx[15] - bity 7 downto 0
-	 *
-	 * bit 127 - ADC reset
-	 * bit 126 - enable PWM1
-	 * bit 125 - enable PWM2
-	 * bit 124 - enable PWM3
-	 * bit 123 - shutdown1
-	 * bit 122 - shutdown2
-	 * bit 121 - shutdown3
-	 * 	.
-	 * bits 47 .. 32 - match PWM1
-	 * bits 31 .. 16 - match PWM2
-	 * bits 15 .. 0  - match PWM3
-	 */
 
+	/* Frame layout is described in rpi_spimc_frame.h */
 	pwm1 = spimcst->pwm[0];
 	pwm2 = spimcst->pwm[1];
 	pwm3 = spimcst->pwm[2];
 
-	tx[0] = 0;
-	if (pwm1 & SPIMC_PWM_ENABLE)
-	  tx[0] |= 1 << 6;
-	if (pwm1 & SPIMC_PWM_SHUTDOWN)
-	  tx[0] |= 1 << 3;
-	if (pwm2 & SPIMC_PWM_ENABLE)
-	  tx[0] |= 1 << 5;
-	if (pwm2 & SPIMC_PWM_SHUTDOWN)
-	  tx[0] |= 1 << 2;
-	if (pwm3 & SPIMC_PWM_ENABLE)
-	  tx[0] |= 1 << 4;
-	if (pwm3 & SPIMC_PWM_SHUTDOWN)
-	  tx[0] |= 1 << 1;
+	txf.adc_reset = 0;
+	txf.pwm1_en = (pwm1 & SPIMC_PWM_ENABLE)? 1: 0;
+	txf.pwm2_en = (pwm2 & SPIMC_PWM_ENABLE)? 1: 0;
+	txf.pwm3_en = (pwm3 & SPIMC_PWM_ENABLE)? 1: 0;
+	txf.pwm1_shdn = (pwm1 & SPIMC_PWM_SHUTDOWN)? 1: 0;
+	txf.pwm2_shdn = (pwm2 & SPIMC_PWM_SHUTDOWN)? 1: 0;
+	txf.pwm3_shdn = (pwm3 & SPIMC_PWM_SHUTDOWN)? 1: 0;
 
 	pwm1 &= SPIMC_PWM_VALUE_m;
 	pwm2 &= SPIMC_PWM_VALUE_m;
 	pwm3 &= SPIMC_PWM_VALUE_m;
 
 	/* keep the cap*/
-	if (pwm1 > 2047) pwm1 = 2047;
-	if (pwm2 > 2047) pwm2 = 2047;
-	if (pwm3 > 2047) pwm3 = 2047;
-
-	/*pwm1*/
-	tx[10] = pwm1 >> 8;   /*MSB*/
-	tx[11] = pwm1 & 0xff; /*LSB*/
-
-	/*pwm2*/
-	tx[12] = pwm2 >> 8;   /*MSB*/
-	tx[13] = pwm2 & 0xff; /*LSB*/
-
-	/*pwm3*/
-	tx[14] = pwm3 >> 8;   /*MSB*/
-	tx[15] = pwm3 & 0xff; /*LSB*/
-
-	struct spi_ioc_transfer tr = {
-		.tx_buf = (uintptr_t)tx,
-		.rx_buf = (uintptr_t)rx,
-		.len = SPIMC_TRANSFER_SIZE,
-		.delay_usecs = spimc_delay,
-		.speed_hz = spimc_speed,
-		.bits_per_word = spimc_bits,
-	};
-
-	ret = ioctl(spimcst->spi_fd, SPI_IOC_MESSAGE(1), &tr);
-	if (ret < 1)
-		return -1;
+	txf.pwm1 = pwm1 > 2047? 2047: pwm1;
+	txf.pwm2 = pwm2 > 2047? 2047: pwm2;
+	txf.pwm3 = pwm3 > 2047? 2047: pwm3;
 
-	/*prichozi data:
-	 * rx[0] - bity 127 downto 120 the first income bit..127
-	 * rx[1] - bity 119 downto 112
-	 * rx[2] - bity 111 downto 104
-	 * rx[3] - bity 103 downto 96
-	 * rx[4] - bity 95 downto 88
-	 * rx[5] - bity 87 downto 80
-	 * rx[6] - bity 79 downto 72
-	 * rx[7] - bity 71 downto 64
-	 * rx[8] - bity 63 downto 56
-	 * rx[9] - bity 55 downto 48
-	 * rx[10] - bity 47 downto 40
-	 * rx[11] - bity 39 downto 32
-	 * rx[12] - bity 31 downto 24
-	 * rx[13] - bity 23 downto 16
-	 * rx[14] - bity 15 downto 8
-	 * rx[15] - bity 7 downto 0	the last income bit..0
-	 */
+	spimc_tx_frame_pack(spimcst->tx_buf, &txf);
+}
 
-	/* position from IRC counter */
-	spimcst->act_pos = ((uint32_t)rx[0] << 24) |
-			   ((uint32_t)rx[1] << 16) |
-			   ((uint32_t)rx[2] << 8) |
-			   ((uint32_t)rx[3] << 0);
+/*
+ * Reject frames which cannot come from a working link. ADC sums
+ * have to fit the sample count (it catches MISO stuck at one too)
+ * and position has to be near the last accepted one. The RX frame
+ * has no spare bits for CRC, it has to be checked here when the
+ * FPGA design gets it.
+ */
+static int spimc_frame_valid(const spimc_state_t *spimcst,
+			     const spimc_rx_frame_t *rxf)
+{
+	uint32_t sum_max = rxf->adc_sqn * SPIMC_CURADC_MAX;
+	int32_t pos_delta;
+
+	if ((rxf->adc_sum0 > sum_max) || (rxf->adc_sum1 > sum_max) ||
+	    (rxf->adc_sum2 > sum_max))
+		return 0;
+
+	if (spimcst->frame_valid) {
+		pos_delta = (int32_t)(rxf->irc_pos - spimcst->act_pos);
+		if (pos_delta < 0)
+			pos_delta = -pos_delta;
+		if ((uint32_t)pos_delta > spimcst->pos_delta_max)
+			return 0;
+	}
 
-	/*halove sondy
-	 * hal1 - bit95
-	 * hal2 - bit94
-	 * hal3 - bit93
-	 */
-	spimcst->hal_sensors = ((0x80 & rx[4]) >> 7) |
-                               ((0x40 & rx[4]) >> 5) |
-                               ((0x20 & rx[4]) >> 3);
-
-	/* index position
-	 * bits 92 downto 81
-	 * 	92..88 in rx[4] last 5 bits (from left)
-	 * 	87..81 in rx[5] first 7 bits (from left)
-	 */
-	idx = 0x1F & rx[4];
-	idx <<= 8;
-	idx |= 0xFE & rx[5];
-	idx >>= 1;
+	return 1;
+}
+
+/* Update measured state from received RX buffer */
+static int spimc_frame_decode(spimc_state_t *spimcst, int check)
+{
+	spimc_rx_frame_t rxf;
+	uint32_t idx;
+	int32_t  idxdiff;
+
+	spimc_rx_frame_unpack(&rxf, spimcst->rx_buf);
+
+	if (check && !spimc_frame_valid(spimcst, &rxf))
+		return -1;
 
+	spimcst->act_pos = rxf.irc_pos;
+	spimcst->hal_sensors = rxf.hal1 | (rxf.hal2 << 1) | (rxf.hal3 << 2);
+
+	/* extend 12-bit index position to full range around actual one */
+	idx = rxf.index_pos;
 	if ((idx ^ spimcst->index_pos) & SPIMC_INDEX_MASK) {
 		idxdiff = (idx - spimcst->act_pos +
 		           (1 << (SPIMC_INDEX_BITS - 1))) & SPIMC_INDEX_MASK;
@@ -183,49 +137,475 @@ int spimc_transfer(spimc_state_t *spimcst)
 		spimcst->index_occur += 1;
 	}
 
-	/* current measurments count
-	 * bits 80 downto 72
-	 * bit 80 in rx[5]
-	 * bits 79..72 in rx[6]
-	 */
+	spimcst->curadc_sqn = rxf.adc_sqn;
+	spimcst->curadc_cumsum[0] = rxf.adc_sum0;
+	spimcst->curadc_cumsum[1] = rxf.adc_sum1;
+	spimcst->curadc_cumsum[2] = rxf.adc_sum2;
+	spimcst->frame_valid = 1;
+
+	return 0;
+}
+
+static void spimc_frame_setup(spimc_state_t *spimcst,
+			      struct spi_ioc_transfer *tr)
+{
+	memset(tr, 0, sizeof(*tr));
+	tr->tx_buf = (uintptr_t)spimcst->tx_buf;
+	tr->rx_buf = (uintptr_t)spimcst->rx_buf;
+	tr->len = SPIMC_TRANSFER_SIZE;
+	tr->delay_usecs = spimcst->spi_delay;
+	tr->speed_hz = spimcst->spi_speed;
+	tr->bits_per_word = spimcst->spi_bits;
+}
+
+static int spimc_frame_xfer(spimc_state_t *spimcst)
+{
+	struct spi_ioc_transfer tr;
+
+	spimc_frame_setup(spimcst, &tr);
+
+	if (ioctl(spimcst->spi_fd, SPI_IOC_MESSAGE(1), &tr) < 1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Accept received frame or repeat the transfer once with the same
+ * PWM values. When the retry fails too, the next frame is accepted
+ * without position check, so the state resynchronizes after real
+ * position jump or long pause between transfers.
+ */
+static int spimc_frame_finish(spimc_state_t *spimcst)
+{
+	if (spimc_frame_decode(spimcst, 1) == 0)
+		return 0;
+	spimcst->frame_errors++;
+
+	if (spimc_frame_xfer(spimcst) == 0) {
+		if (spimc_frame_decode(spimcst, 1) == 0) {
+			spimcst->frame_retries++;
+			return 0;
+		}
+		spimcst->frame_errors++;
+	}
+
+	spimcst->frame_failures++;
+	spimcst->frame_valid = 0;
+
+	return -1;
+}
+
+/* Transfer without frame validation, used by link training */
+static int spimc_transfer_raw(spimc_state_t *spimcst)
+{
+	spimc_frame_prepare(spimcst);
+
+	if (spimc_frame_xfer(spimcst) < 0)
+		return -1;
+
+	spimc_frame_decode(spimcst, 0);
+
+	return 0;
+}
+
+int spimc_transfer(spimc_state_t *spimcst)
+{
+	spimc_frame_prepare(spimcst);
+
+	if (spimc_frame_xfer(spimcst) < 0)
+		return -1;
+
+	return spimc_frame_finish(spimcst);
+}
+
+/*
+ * Frames of boards sharing one SPI device node are exchanged in one
+ * SPI_IOC_MESSAGE, chip select is released between them. Runs of
+ * states on different nodes are sent as separate messages.
+ */
+int spimc_transfer_batch(spimc_state_t *const *spimcst, int count)
+{
+	struct spi_ioc_transfer tr[SPIMC_BATCH_MAX];
+	int ret = 0;
+	int i, j, n;
+
+	for (i = 0; i < count; i++)
+		spimc_frame_prepare(spimcst[i]);
+
+	for (i = 0; i < count; i += n) {
+		spimc_frame_setup(spimcst[i], &tr[0]);
+		for (n = 1; (i + n < count) && (n < SPIMC_BATCH_MAX); n++) {
+			if (strcmp(spimcst[i + n]->spi_dev, spimcst[i]->spi_dev))
+				break;
+			tr[n - 1].cs_change = 1;
+			spimc_frame_setup(spimcst[i + n], &tr[n]);
+		}
+
+		if (ioctl(spimcst[i]->spi_fd, SPI_IOC_MESSAGE(n), tr) < 1)
+			return -1;
+
+		for (j = 0; j < n; j++)
+			if (spimc_frame_finish(spimcst[i + j]) < 0)
+				ret = -1;
+	}
+
+	return ret;
+}
+
+struct spimc_async_t {
+	pthread_t thread;
+	sem_t     submit_sem;
+	sem_t     done_sem;
+	volatile int quit;
+};
+
+static void *spimc_async_thread(void *arg)
+{
+	spimc_state_t *spimcst = arg;
+	struct spimc_async_t *as = spimcst->async;
+
+	while (1) {
+		while (sem_wait(&as->submit_sem) < 0)
+			;
+		if (as->quit)
+			break;
+		spimcst->xfer_ret = spimc_frame_xfer(spimcst);
+		sem_post(&as->done_sem);
+	}
+
+	return NULL;
+}
+
+/*
+ * Start I/O thread which runs SPI_IOC_MESSAGE for spimc_submit().
+ * SCHED_FIFO is used for positive prio, default scheduling
+ * is used for zero or when realtime priority cannot be set.
+ */
+int spimc_async_start(spimc_state_t *spimcst, int prio)
+{
+	struct spimc_async_t *as;
+	pthread_attr_t attr;
+	struct sched_param schparam;
+	int policy;
+	int ret;
+
+	if (spimcst->async != NULL)
+		return 0;
 
-	spimcst->curadc_sqn = 0x01 & rx[5];
-	spimcst->curadc_sqn <<= 8;
-	spimcst->curadc_sqn |= rx[6];
-
-
-	/** currents
-	 * ch2 - bits 71 downto 48
-	 * 	71..64 in rx[7] - all byte
-	 * 	63..56 in rx[8] - all byte
-	 * 	55..48 in rx[9] - all byte
-	 * ch0 - bits 47 downto 24
-	 * 	47..40 in rx[10] - all byte
-	 * 	39..32 in rx[11] - all byte
-	 * 	31..24 in rx[12] - all byte
-	 * ch1 - bits 23 downto 0
-	 * 	23..16 in rx[13] - all byte
-	 * 	15..8 in rx[14] - all byte
-	 * 	7..0 in rx[15] - all byte
+	if (prio == SPIMC_ASYNC_PRIO_CALLER) {
+		prio = 0;
+		if ((pthread_getschedparam(pthread_self(), &policy, &schparam) == 0) &&
+		    ((policy == SCHED_FIFO) || (policy == SCHED_RR)))
+			prio = schparam.sched_priority + 1;
+		if (prio > sched_get_priority_max(SCHED_FIFO))
+			prio = sched_get_priority_max(SCHED_FIFO);
+	}
+
+	as = malloc(sizeof(*as));
+	if (as == NULL)
+		return -1;
+	memset(as, 0, sizeof(*as));
+	sem_init(&as->submit_sem, 0, 0);
+	sem_init(&as->done_sem, 0, 0);
+	spimcst->async = as;
+
+	ret = -1;
+	if (prio > 0) {
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		schparam.sched_priority = prio;
+		pthread_attr_setschedparam(&attr, &schparam);
+		ret = pthread_create(&as->thread, &attr, spimc_async_thread, spimcst);
+		pthread_attr_destroy(&attr);
+		if (ret != 0)
+			fprintf(stderr, "spimc I/O thread priority %d not allowed\n", prio);
+	}
+	if (ret != 0)
+		ret = pthread_create(&as->thread, NULL, spimc_async_thread, spimcst);
+
+	if (ret != 0) {
+		spimcst->async = NULL;
+		sem_destroy(&as->submit_sem);
+		sem_destroy(&as->done_sem);
+		free(as);
+		return -1;
+	}
+
+	return 0;
+}
+
+void spimc_async_stop(spimc_state_t *spimcst)
+{
+	struct spimc_async_t *as = spimcst->async;
+
+	if (as == NULL)
+		return;
+
+	if (spimcst->xfer_pending)
+		spimc_complete(spimcst);
+
+	as->quit = 1;
+	sem_post(&as->submit_sem);
+	pthread_join(as->thread, NULL);
+	spimcst->async = NULL;
+	sem_destroy(&as->submit_sem);
+	sem_destroy(&as->done_sem);
+	free(as);
+}
+
+int spimc_submit(spimc_state_t *spimcst)
+{
+	if (spimcst->xfer_pending)
+		return -1;
+
+	spimc_frame_prepare(spimcst);
+	spimcst->xfer_pending = 1;
+
+	if (spimcst->async != NULL)
+		sem_post(&spimcst->async->submit_sem);
+	else
+		spimcst->xfer_ret = spimc_frame_xfer(spimcst);
+
+	return 0;
+}
+
+int spimc_complete(spimc_state_t *spimcst)
+{
+	if (!spimcst->xfer_pending)
+		return -1;
+
+	if (spimcst->async != NULL)
+		while (sem_wait(&spimcst->async->done_sem) < 0)
+			;
+	spimcst->xfer_pending = 0;
+
+	if (spimcst->xfer_ret < 0)
+		return -1;
+
+	return spimc_frame_finish(spimcst);
+}
+
+/*
+ * Compute average phase currents of the last period from ADC sums
+ * into curadc_val[] with SPIMC_CURADC_FRACT fractional bits
+ * and offsets subtracted. The RPI-MI-1 design restarts sums
+ * at each transfer. Returns -1 and keeps previous values
+ * when sample count is out of the valid range.
+ */
+int spimc_curadc_currents(spimc_state_t *spimcst)
+{
+	uint32_t sqn_diff;
+	uint32_t val_diff;
+	uint32_t recip;
+	int i;
+
+	sqn_diff = spimcst->curadc_sqn & SPIMC_CURADC_SQN_m;
+	if ((sqn_diff <= 1) || (sqn_diff > SPIMC_CURADC_SQN_MAX))
+		return -1;
+
+	recip = spimc_curadc_recip[sqn_diff];
+
+	for (i = 0; i < SPIMC_CHAN_COUNT; i++) {
+		val_diff = spimcst->curadc_cumsum[i] & SPIMC_CURADC_SUM_m;
+		spimcst->curadc_val[i] =
+			(int32_t)(((uint64_t)val_diff * recip) >>
+				  (32 - SPIMC_CURADC_FRACT)) -
+			(spimcst->curadc_offs[i] << SPIMC_CURADC_FRACT);
+	}
+
+	return 0;
+}
+
+/*
+ * Average ADC readings over given number of periods with all
+ * PWM outputs shut down and store them as current offsets.
+ */
+int spimc_curadc_calibrate(spimc_state_t *spimcst, int periods,
+			   unsigned int period_usec)
+{
+	uint64_t val_sum[SPIMC_CHAN_COUNT] = {0, 0, 0};
+	uint32_t sqn_sum = 0;
+	uint32_t sqn_diff;
+	int i;
+
+	for (i = 0; i < SPIMC_CHAN_COUNT; i++)
+		spimcst->pwm[i] = SPIMC_PWM_SHUTDOWN;
+
+	/*
+	 * discard sums accumulated before outputs have been disabled,
+	 * periods with rejected frames are skipped, dead link ends
+	 * without any sample
 	 */
+	spimc_transfer(spimcst);
+
+	while (periods-- > 0) {
+		usleep(period_usec);
+		if (spimc_transfer(spimcst) < 0)
+			continue;
+		sqn_diff = spimcst->curadc_sqn & SPIMC_CURADC_SQN_m;
+		if ((sqn_diff <= 1) || (sqn_diff > SPIMC_CURADC_SQN_MAX))
+			continue;
+		for (i = 0; i < SPIMC_CHAN_COUNT; i++)
+			val_sum[i] += spimcst->curadc_cumsum[i] &
+				      SPIMC_CURADC_SUM_m;
+		sqn_sum += sqn_diff;
+	}
+
+	if (!sqn_sum)
+		return -1;
+
+	for (i = 0; i < SPIMC_CHAN_COUNT; i++)
+		spimcst->curadc_offs[i] = (val_sum[i] + sqn_sum / 2) / sqn_sum;
+
+	return 0;
+}
 
-	spimcst->curadc_cumsum[2] = rx[7];
-	spimcst->curadc_cumsum[2] <<= 8;
-	spimcst->curadc_cumsum[2] |= rx[8];
-	spimcst->curadc_cumsum[2] <<= 8;
-	spimcst->curadc_cumsum[2] |= rx[9];
+/*
+ * Set the maximal clock of the device, the driver may round
+ * requested value down. The actual value is read back.
+ */
+int spimc_set_speed(spimc_state_t *spimcst, uint32_t speed)
+{
+	if (ioctl(spimcst->spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) == -1)
+		return -1;
+	if (ioctl(spimcst->spi_fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed) == -1)
+		return -1;
+	spimcst->spi_speed = speed;
+	return 0;
+}
+
+/* Average duration of the transfer at actual speed in transfer_nsec */
+int spimc_measure_transfer(spimc_state_t *spimcst, int count)
+{
+	struct timespec t0, t1;
+	int64_t nsec;
+	int i;
 
-	spimcst->curadc_cumsum[0] = rx[10];
-	spimcst->curadc_cumsum[0] <<= 8;
-	spimcst->curadc_cumsum[0] |= rx[11];
-	spimcst->curadc_cumsum[0] <<= 8;
-	spimcst->curadc_cumsum[0] |=rx [12];
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < count; i++)
+		if (spimc_transfer(spimcst) < 0)
+			return -1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
 
-	spimcst->curadc_cumsum[1] = rx[13];
-	spimcst->curadc_cumsum[1] <<= 8;
-	spimcst->curadc_cumsum[1] |= rx[14];
-	spimcst->curadc_cumsum[1] <<= 8;
-	spimcst->curadc_cumsum[1] |= rx[15];
+	nsec = (int64_t)(t1.tv_sec - t0.tv_sec) * 1000000000 +
+	       (t1.tv_nsec - t0.tv_nsec);
+	spimcst->transfer_nsec = count? nsec / count: 0;
+
+	return 0;
+}
+
+/*
+ * Check the frame received at tested speed against frames
+ * received just before and after at the reference speed.
+ * The FPGA has no loopback, but the motor is still during
+ * training, so position, index and hall sensors have to
+ * match the references and ADC sums have to be consistent
+ * with the sample count.
+ */
+static int spimc_train_frame_ok(const spimc_state_t *ref0,
+				const spimc_state_t *tst,
+				const spimc_state_t *ref1)
+{
+	int32_t span = (int32_t)(ref1->act_pos - ref0->act_pos);
+	int32_t dist = (int32_t)(tst->act_pos - ref0->act_pos);
+	uint32_t sqn;
+	int i;
+
+	if (span < 0)
+		span = -span;
+	if (dist < 0)
+		dist = -dist;
+	if (dist > span + SPIMC_TRAIN_POS_TOL)
+		return 0;
+
+	if ((tst->hal_sensors != ref0->hal_sensors) &&
+	    (tst->hal_sensors != ref1->hal_sensors))
+		return 0;
+
+	if (((tst->index_pos ^ ref0->index_pos) & SPIMC_INDEX_MASK) &&
+	    ((tst->index_pos ^ ref1->index_pos) & SPIMC_INDEX_MASK))
+		return 0;
+
+	sqn = tst->curadc_sqn & SPIMC_CURADC_SQN_m;
+	for (i = 0; i < SPIMC_CHAN_COUNT; i++)
+		if ((tst->curadc_cumsum[i] & SPIMC_CURADC_SUM_m) >
+		    sqn * SPIMC_CURADC_MAX)
+			return 0;
+
+	return 1;
+}
+
+/*
+ * Step SPI clock up from the actual (known good) speed up to
+ * speed_max. Each speed is accepted when all trials interleaved
+ * with reference transfers at the starting speed pass. The link
+ * is left one step below the last clean speed when some speed
+ * fails. PWM outputs are shut down during training.
+ */
+int spimc_train_link(spimc_state_t *spimcst, uint32_t speed_max, int trials)
+{
+	spimc_state_t ref0, tst;
+	uint32_t speed_ref = spimcst->spi_speed;
+	uint32_t speed_ok = speed_ref;
+	uint32_t speed_prev = speed_ref;
+	uint32_t target;
+	uint32_t speed;
+	int failed = 0;
+	int fails;
+	int i;
+
+	for (i = 0; i < SPIMC_CHAN_COUNT; i++)
+		spimcst->pwm[i] = SPIMC_PWM_SHUTDOWN;
+
+	for (target = speed_ref; target < speed_max; ) {
+		target = (uint64_t)target * SPIMC_TRAIN_STEP_PCT / 100;
+		if (target > speed_max)
+			target = speed_max;
+
+		if (spimc_set_speed(spimcst, target) < 0)
+			return -1;
+		speed = spimcst->spi_speed;
+		if (speed <= speed_ok)
+			continue;
+
+		spimcst->spi_speed = speed_ref;
+		if (spimc_transfer_raw(spimcst) < 0)
+			return -1;
+		for (fails = 0, i = 0; i < trials; i++) {
+			ref0 = *spimcst;
+			spimcst->spi_speed = speed;
+			if (spimc_transfer_raw(spimcst) < 0)
+				return -1;
+			tst = *spimcst;
+			spimcst->spi_speed = speed_ref;
+			if (spimc_transfer_raw(spimcst) < 0)
+				return -1;
+			if (!spimc_train_frame_ok(&ref0, &tst, spimcst) &&
+			    (++fails > SPIMC_TRAIN_FAIL_MAX))
+				break;
+		}
+		if (i < trials) {
+			failed = 1;
+			break;
+		}
+		speed_prev = speed_ok;
+		speed_ok = speed;
+	}
+
+	if (failed)
+		speed_ok = speed_prev;
+
+	if (spimc_set_speed(spimcst, speed_ok) < 0)
+		return -1;
+
+	if (spimc_measure_transfer(spimcst, trials) < 0)
+		return -1;
+
+	printf("spi trained speed: %lu Hz, transfer %lu ns\n",
+	       (unsigned long)spimcst->spi_speed,
+	       (unsigned long)spimcst->transfer_nsec);
 
 	return 0;
 }
@@ -234,51 +614,64 @@ int spimc_init(spimc_state_t *spimcst)
 {
 	int ret = 0;
 	int fd;
+	uint32_t sqn;
 
 	spimcst->spi_fd = -1;
 
+	if (!spimcst->spi_bits)
+		spimcst->spi_bits = 8;
+	if (!spimcst->spi_speed)
+		spimcst->spi_speed = SPIMC_SPEED_DEFAULT;
+	if (!spimcst->pos_delta_max)
+		spimcst->pos_delta_max = SPIMC_FRAME_POS_DELTA_DEFAULT;
+	spimcst->frame_valid = 0;
+
+	for (sqn = 2; sqn <= SPIMC_CURADC_SQN_MAX; sqn++)
+		spimc_curadc_recip[sqn] = 0xffffffff / sqn + 1;
+
 	fd = open(spimcst->spi_dev, O_RDWR);
 	if (fd < 0) {
 		pabort("can't open device");
 	}
 	printf("device open\n");
 	/*
-	 * spi spimc_mode
+	 * spi mode
 	 */
-	ret = ioctl(fd, SPI_IOC_WR_MODE, &spimc_mode);
+	ret = ioctl(fd, SPI_IOC_WR_MODE, &spimcst->spi_mode);
 	if (ret == -1)
 		pabort("can't set spi mode");
 
-	ret = ioctl(fd, SPI_IOC_RD_MODE, &spimc_mode);
+	ret = ioctl(fd, SPI_IOC_RD_MODE, &spimcst->spi_mode);
 	if (ret == -1)
 		pabort("can't get spi mode");
 
 	/*
 	 * bits per word
 	 */
-	ret = ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &spimc_bits);
+	ret = ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &spimcst->spi_bits);
 	if (ret == -1)
 		pabort("can't set bits per word");
 
-	ret = ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &spimc_bits);
+	ret = ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &spimcst->spi_bits);
 	if (ret == -1)
 		pabort("can't get bits per word");
 
 	/*
-	 * max spimc_speed hz
+	 * max speed hz
 	 */
-	ret = ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &spimc_speed);
+	ret = ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &spimcst->spi_speed);
 	if (ret == -1)
 		pabort("can't set max speed hz");
 
-	ret = ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &spimc_speed);
+	ret = ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &spimcst->spi_speed);
 	if (ret == -1)
 		pabort("can't get max speed hz");
 
-	printf("spi spimc_mode: %d\n", spimc_mode);
-	printf("bits per word: %d\n", spimc_bits);
-	printf("delay: %d\n", spimc_delay);
-	printf("max spimc_speed: %d Hz (%d KHz)\n", spimc_speed, spimc_speed/1000);
+	printf("spi mode: %d\n", spimcst->spi_mode);
+	printf("bits per word: %d\n", spimcst->spi_bits);
+	printf("delay: %lu\n", (unsigned long)spimcst->spi_delay);
+	printf("max speed: %lu Hz (%lu KHz)\n", (unsigned long)spimcst->spi_speed,
+	       (unsigned long)spimcst->spi_speed/1000);
 
 	spimcst->spi_fd = fd;
 
@@ -10,9 +10,44 @@
 #define SPIMC_PWM_ENABLE    0x10000
 #define SPIMC_PWM_SHUTDOWN  0x20000
 
+#define SPIMC_CURADC_SQN_m    0x1ff
+#define SPIMC_CURADC_SUM_m    0xffffff
+/* Longest accumulation period which does not overflow 24-bit sums */
+#define SPIMC_CURADC_SQN_MAX  450
+/* Fractional bits of currents returned by spimc_curadc_currents */
+#define SPIMC_CURADC_FRACT    8
+
+#define SPIMC_SPEED_DEFAULT   500000
+/* Upper limit for link training, RPi SPI clock is core clock / 2n */
+#define SPIMC_TRAIN_SPEED_MAX 32000000
+
+/* Largest position change between consecutive accepted frames */
+#define SPIMC_FRAME_POS_DELTA_DEFAULT 16384
+
+/* Frames exchanged in one SPI_IOC_MESSAGE by spimc_transfer_batch */
+#define SPIMC_BATCH_MAX       8
+
+/* I/O thread priority one above the thread calling spimc_async_start */
+#define SPIMC_ASYNC_PRIO_CALLER  -1
+
+struct spimc_async_t;
+
 typedef struct spimc_state_t {
   char     *spi_dev;
   int      spi_fd;
+  uint8_t  spi_mode;
+  uint8_t  spi_bits;
+  uint16_t spi_delay;
+  uint32_t spi_speed;
+  uint32_t transfer_nsec;
+  struct spimc_async_t *async;
+  int      xfer_pending;
+  int      xfer_ret;
+  uint32_t pos_delta_max;
+  int      frame_valid;
+  uint32_t frame_errors;    /* rejected frames */
+  uint32_t frame_retries;   /* transfers recovered by retry */
+  uint32_t frame_failures;  /* transfers failed after retry */
   uint32_t pwm[SPIMC_CHAN_COUNT];
   uint32_t act_pos;
   uint32_t index_pos;
@@ -31,6 +66,50 @@ typedef struct spimc_state_t {
 
 int spimc_init(spimc_state_t *spimcst);
 
+/*
+ * Received frame is validated against the previous one and the
+ * transfer is repeated once when it is rejected. Counters of
+ * rejected frames, retries and failures are kept in the state.
+ */
 int spimc_transfer(spimc_state_t *spimcst);
 
+/*
+ * Transfer for several boards at once, states on the same
+ * spi_dev have to follow each other to share one message.
+ */
+int spimc_transfer_batch(spimc_state_t *const *spimcst, int count);
+
+/*
+ * Split transfer, spimc_submit() takes PWM values and starts
+ * the exchange on I/O thread (or performs it synchronously when
+ * the thread is not started), spimc_complete() waits for it and
+ * updates measured values. The caller may prepare next PWM
+ * values between them, buffers are owned by the transfer.
+ *
+ * The cycle shrinks from transfer + step to the longer of them
+ * plus thread hand-over (2 to 3 us measured by benchpipe under
+ * spimc_emul), at the price of one period older measurements.
+ * It pays off only for steps longer than the hand-over and with
+ * spare CPU for the I/O thread, the native FOC step (~30 ns)
+ * is better served by sequential transfers.
+ */
+int spimc_async_start(spimc_state_t *spimcst, int prio);
+
+void spimc_async_stop(spimc_state_t *spimcst);
+
+int spimc_submit(spimc_state_t *spimcst);
+
+int spimc_complete(spimc_state_t *spimcst);
+
+int spimc_set_speed(spimc_state_t *spimcst, uint32_t speed);
+
+int spimc_measure_transfer(spimc_state_t *spimcst, int count);
+
+int spimc_train_link(spimc_state_t *spimcst, uint32_t speed_max, int trials);
+
+int spimc_curadc_currents(spimc_state_t *spimcst);
+
+int spimc_curadc_calibrate(spimc_state_t *spimcst, int periods,
+			   unsigned int period_usec);
+
 #endif /*_RPI_SPIMC_H*/
\ No newline at end of file
@@ -0,0 +1,158 @@
+/*
+  Frame layout of SPI communication with RPI-MI-1 FPGA
+  3-phase motor control design by Martin Prudek.
+
+  Each field is declared once by the position of its most
+  significant bit in the 128-bit frame (bit 127 is the first
+  bit on the wire, MSB of byte 0), its width and signedness.
+  Pack and unpack functions for both directions are expanded
+  from the lists, with constant positions folded by compiler
+  to plain shifts and masks. The master side (rpi_spi.c)
+  packs TX and unpacks RX frames, the FPGA emulator does
+  the opposite. The header is shared with rpi_spimc_module
+  kernel driver. The field positions are taken over from
+  rpi_spi.c.
+
+  (C) 2015 by Martin Prudek prudemar@fel.cvut.cz (rpi_spi.c)
+  (C) 2015 by Pavel Pisa pisa@cmp.felk.cvut.cz (rpi_spi.c)
+  (C) 2026 rpi-rt-control contributors
+ */
+
+#ifndef _RPI_SPIMC_FRAME_H
+#define _RPI_SPIMC_FRAME_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#endif
+
+#define SPIMC_FRAME_SIZE 16
+
+/* X(name, msb, width, signed) */
+#define SPIMC_TX_FIELDS(X) \
+	X(adc_reset, 127,  1, 0) \
+	X(pwm1_en,   126,  1, 0) \
+	X(pwm2_en,   125,  1, 0) \
+	X(pwm3_en,   124,  1, 0) \
+	X(pwm1_shdn, 123,  1, 0) \
+	X(pwm2_shdn, 122,  1, 0) \
+	X(pwm3_shdn, 121,  1, 0) \
+	X(pwm1,       47, 16, 0) \
+	X(pwm2,       31, 16, 0) \
+	X(pwm3,       15, 16, 0)
+
+#define SPIMC_RX_FIELDS(X) \
+	X(irc_pos,   127, 32, 0) \
+	X(hal1,       95,  1, 0) \
+	X(hal2,       94,  1, 0) \
+	X(hal3,       93,  1, 0) \
+	X(index_pos,  92, 12, 0) \
+	X(adc_sqn,    80,  9, 0) \
+	X(adc_sum2,   71, 24, 0) \
+	X(adc_sum0,   47, 24, 0) \
+	X(adc_sum1,   23, 24, 0)
+
+#define SPIMC_FRAME_FIELD_TYPE_0 uint32_t
+#define SPIMC_FRAME_FIELD_TYPE_1 int32_t
+
+#define SPIMC_FRAME_FIELD_DECL(name, msb, width, sgn) \
+	SPIMC_FRAME_FIELD_TYPE_##sgn name;
+
+typedef struct spimc_tx_frame_t {
+	SPIMC_TX_FIELDS(SPIMC_FRAME_FIELD_DECL)
+} spimc_tx_frame_t;
+
+typedef struct spimc_rx_frame_t {
+	SPIMC_RX_FIELDS(SPIMC_FRAME_FIELD_DECL)
+} spimc_rx_frame_t;
+
+/*
+ * The frame is held in two words, w[0] holds bits 127..64
+ * and w[1] bits 63..0.
+ */
+static inline __attribute__((always_inline))
+void spimc_frame_load(uint64_t w[2], const uint8_t *buf)
+{
+	memcpy(w, buf, SPIMC_FRAME_SIZE);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	w[0] = __builtin_bswap64(w[0]);
+	w[1] = __builtin_bswap64(w[1]);
+#endif
+}
+
+static inline __attribute__((always_inline))
+void spimc_frame_store(uint8_t *buf, uint64_t w[2])
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	w[0] = __builtin_bswap64(w[0]);
+	w[1] = __builtin_bswap64(w[1]);
+#endif
+	memcpy(buf, w, SPIMC_FRAME_SIZE);
+}
+
+static inline __attribute__((always_inline))
+uint32_t spimc_frame_get(const uint64_t w[2], int msb, int width, int sgn)
+{
+	int lsb = msb - width + 1;
+	uint64_t v;
+
+	if (lsb >= 64)
+		v = w[0] >> (lsb - 64);
+	else if (msb < 64)
+		v = w[1] >> lsb;
+	else
+		v = (w[1] >> lsb) | (w[0] << (64 - lsb));
+
+	v &= ((uint64_t)1 << width) - 1;
+	if (sgn && (v & ((uint64_t)1 << (width - 1))))
+		v |= ~(((uint64_t)1 << width) - 1);
+
+	return (uint32_t)v;
+}
+
+static inline __attribute__((always_inline))
+void spimc_frame_put(uint64_t w[2], int msb, int width, uint32_t val)
+{
+	int lsb = msb - width + 1;
+	uint64_t v = val & (((uint64_t)1 << width) - 1);
+
+	if (lsb >= 64) {
+		w[0] |= v << (lsb - 64);
+	} else if (msb < 64) {
+		w[1] |= v << lsb;
+	} else {
+		w[1] |= v << lsb;
+		w[0] |= v >> (64 - lsb);
+	}
+}
+
+#define SPIMC_FRAME_FIELD_PUT(name, msb, width, sgn) \
+	spimc_frame_put(w, msb, width, f->name);
+
+#define SPIMC_FRAME_FIELD_GET(name, msb, width, sgn) \
+	f->name = spimc_frame_get(w, msb, width, sgn);
+
+/* Bits not covered by any field are transmitted as zero */
+#define SPIMC_FRAME_CODEC(dir, fields) \
+static inline \
+void spimc_##dir##_frame_pack(uint8_t *buf, const spimc_##dir##_frame_t *f) \
+{ \
+	uint64_t w[2] = {0, 0}; \
+	fields(SPIMC_FRAME_FIELD_PUT) \
+	spimc_frame_store(buf, w); \
+} \
+static inline \
+void spimc_##dir##_frame_unpack(spimc_##dir##_frame_t *f, const uint8_t *buf) \
+{ \
+	uint64_t w[2]; \
+	spimc_frame_load(w, buf); \
+	fields(SPIMC_FRAME_FIELD_GET) \
+}
+
+SPIMC_FRAME_CODEC(tx, SPIMC_TX_FIELDS)
+SPIMC_FRAME_CODEC(rx, SPIMC_RX_FIELDS)
+
+#endif /*_RPI_SPIMC_FRAME_H*/
@@ -42,6 +42,12 @@
  * Counter Gating
  * Reset Control
  * Digital Filter
+ * Reset at Startup
+ * Sample Actuate  - optional, 1 reads the counter in mdlOutputs
+ *                   so the output is the position at the start of
+ *                   the step instead of the one read in the previous
+ *                   mdlUpdate, see sfPMSMonSPI.c for the phase margin
+ *                   gained
  */
 
 #define PRM_TS(S)               (mxGetScalar(ssGetSFcnParam(S, 0)))
@@ -51,8 +57,11 @@
 #define PRM_RESET_CONTROL(S)    (mxGetScalar(ssGetSFcnParam(S, 4)))
 #define PRM_DIGITAL_FILTER(S)   (mxGetScalar(ssGetSFcnParam(S, 5)))
 #define PRM_RESET_AT_STARTUP(S) (mxGetScalar(ssGetSFcnParam(S, 6)))
+#define PRM_SAMPLE_ACTUATE(S)   (ssGetSFcnParamsCount(S) > 7? \
+                                 mxGetScalar(ssGetSFcnParam(S, 7)): 0)
 
-#define PRM_COUNT                   7
+#define PRM_COUNT_MIN               7
+#define PRM_COUNT                   8
 
 #define IWORK_IDX_CHANNEL           0
 #define IWORK_IDX_USE_GATING_INPUT  1
@@ -165,6 +174,8 @@ static void mdlCheckParameters(SimStruct *S)
   #endif
     if ((PRM_RESET_AT_STARTUP(S) != 0) && (PRM_RESET_AT_STARTUP(S) != 1))
         ssSetErrorStatus(S, "Reset at startup can be only 0 or 1");
+    if ((PRM_SAMPLE_ACTUATE(S) != 0) && (PRM_SAMPLE_ACTUATE(S) != 1))
+        ssSetErrorStatus(S, "Sample Actuate can be only 0 or 1");
 }
 #endif /* MDL_CHECK_PARAMETERS */
 
@@ -179,10 +190,11 @@ static void mdlInitializeSizes(SimStruct *S)
     int_T nInputPorts  = 0;
     int_T i;
 
-    ssSetNumSFcnParams(S, PRM_COUNT);  /* Number of expected parameters */
-    if (ssGetNumSFcnParams(S) != ssGetSFcnParamsCount(S)) {
-        /* Return if number of expected != number of actual parameters */
-        ssSetErrorStatus(S, "6-parameters requited: Ts, Channel, Counter Mode, Counter Gating, Reset Control and Digital Filter");
+    /* Models created before Sample Actuate was added pass 7 parameters */
+    ssSetNumSFcnParams(S, -1);
+    if ((ssGetSFcnParamsCount(S) < PRM_COUNT_MIN) ||
+        (ssGetSFcnParamsCount(S) > PRM_COUNT)) {
+        ssSetErrorStatus(S, "7 or 8 parameters requited: Ts, Channel, Counter Mode, Counter Gating, Reset Control, Digital Filter, Reset at Startup and Sample Actuate");
         return;
     }
 
@@ -334,6 +346,19 @@ static void mdlOutputs(SimStruct *S, int_T tid)
     int32_T *y = ssGetOutputPortSignal(S,0);
 
   #ifndef WITHOUT_HW
+    if (PRM_SAMPLE_ACTUATE(S)) {
+        uint32_t irc_val_raw = 0;
+        int_T irc_dev_fd = IWORK_IRC_DEV_FD(S);
+
+        if (irc_dev_fd != -1) {
+            if (read(irc_dev_fd, &irc_val_raw, sizeof(uint32_t)) !=
+                sizeof(uint32_t)) {
+                ssSetErrorStatus(S, "/dev/ircX read failed");
+            }
+            IWORK_IRC_ACT_VAL(S) = (int32_t)irc_val_raw;
+        }
+    }
+
     y[0] = (int32_t)(IWORK_IRC_ACT_VAL(S) + IWORK_IRC_OFFSET(S));
   #else /*WITHOUT_HW*/
     y[0] = 0;
@@ -362,11 +387,14 @@ static void mdlUpdate(SimStruct *S, int_T tid)
     if (irc_dev_fd == -1)
         return;
 
-    if (read(irc_dev_fd, &irc_val_raw, sizeof(uint32_t)) != sizeof(uint32_t)) {
-        ssSetErrorStatus(S, "/dev/ircX read failed");
-    }
+    /* In sample-then-actuate mode the counter has been read in mdlOutputs */
+    if (!PRM_SAMPLE_ACTUATE(S)) {
+        if (read(irc_dev_fd, &irc_val_raw, sizeof(uint32_t)) != sizeof(uint32_t)) {
+            ssSetErrorStatus(S, "/dev/ircX read failed");
+        }
 
-    IWORK_IRC_ACT_VAL(S) = (int32_t)irc_val_raw;
+        IWORK_IRC_ACT_VAL(S) = (int32_t)irc_val_raw;
+    }
 
     if (IWORK_USE_GATING_INPUT(S)) {
         const uint8_T *u = (const uint8_T*) ssGetInputPortSignal(S, inp_num);
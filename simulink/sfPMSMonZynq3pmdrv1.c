@@ -38,15 +38,26 @@
  * The S-function has next parameters
  *
  * Sample time     - sample time value or -1 for inherited
- * Counter Mode    -
- * Counter Gating
- * Reset Control
- * Digital Filter
+ * Registers Base  - physical address of the IP core, 0 for default,
+ *                   optional, it selects the axis in multi-axis
+ *                   designs, it has to be 0 with Z3PMDRV1_UIO_DEV
+ * Sample Actuate  - optional, 1 reads the feedback registers at the start
+ *                   of the step in mdlOutputs and writes PWM registers
+ *                   in mdlUpdate, 0 (default) does both in mdlUpdate
+ *                   and the outputs lag by one sample
+ *
+ * See sfPMSMonSPI.c for the phase margin gained by sample-then-actuate.
+ * Registers are accessed separately here, so no extra transfer is needed.
  */
 
 #define PRM_TS(S)               (mxGetScalar(ssGetSFcnParam(S, 0)))
+#define PRM_REGS_BASE(S)        (ssGetSFcnParamsCount(S) > 1? \
+                                 mxGetScalar(ssGetSFcnParam(S, 1)): 0)
+#define PRM_SAMPLE_ACTUATE(S)   (ssGetSFcnParamsCount(S) > 2? \
+                                 mxGetScalar(ssGetSFcnParam(S, 2)): 0)
 
-#define PRM_COUNT                   1
+#define PRM_COUNT_MIN               1
+#define PRM_COUNT                   3
 
 #define PWORK_IDX_Z3PMDRV1_STATE       0
 
@@ -54,6 +65,21 @@
 
 #define PWORK_Z3PMDRV1_STATE(S)        (ssGetPWork(S)[PWORK_IDX_Z3PMDRV1_STATE])
 
+/* ADC offsets are averaged over this number of sample periods at start */
+#define CURADC_CALIB_PERIODS        200
+
+/*
+ * UIO device of the IP core (e.g. -DZ3PMDRV1_UIO_DEV=\"/dev/uio0\"),
+ * registers are mapped from /dev/mem when it is not defined.
+ * With the interrupt available, the transfer in mdlUpdate (or the sampling
+ * in mdlOutputs in sample-then-actuate mode) waits for the start of PWM
+ * period.
+ */
+#ifndef Z3PMDRV1_UIO_DEV
+#define Z3PMDRV1_UIO_DEV            NULL
+#endif
+#define PERIOD_WAIT_USEC            10000
+
 enum {
     sIn_N_PWM_VAL = 0,  /* PWM value [3 x 1]  */
     sIn_N_PWM_EN,       /* PWM enable [3 x 1] */
@@ -88,6 +114,9 @@ enum {
 
 #endif /*WITHOUT_HW*/
 
+/* UIO node maps one IP core, the axis is selected by the node instead */
+static char *const z3pmdrv1_uio_dev = Z3PMDRV1_UIO_DEV;
+
 /* Error handling
  * --------------
  *
@@ -129,6 +158,12 @@ static void mdlCheckParameters(SimStruct *S)
 {
     if ((PRM_TS(S) < 0) && (PRM_TS(S) != -1))
         ssSetErrorStatus(S, "Ts has to be positive or -1 for automatic step");
+    if (PRM_REGS_BASE(S) < 0)
+        ssSetErrorStatus(S, "Registers Base has to be physical address or 0");
+    if ((z3pmdrv1_uio_dev != NULL) && (PRM_REGS_BASE(S) != 0))
+        ssSetErrorStatus(S, "Registers Base has to be 0 when built for UIO device");
+    if ((PRM_SAMPLE_ACTUATE(S) != 0) && (PRM_SAMPLE_ACTUATE(S) != 1))
+        ssSetErrorStatus(S, "Sample Actuate can be only 0 or 1");
 }
 #endif /* MDL_CHECK_PARAMETERS */
 
@@ -140,10 +175,11 @@ static void mdlCheckParameters(SimStruct *S)
  */
 static void mdlInitializeSizes(SimStruct *S)
 {
-    ssSetNumSFcnParams(S, PRM_COUNT);  /* Number of expected parameters */
-    if (ssGetNumSFcnParams(S) != ssGetSFcnParamsCount(S)) {
-        /* Return if number of expected != number of actual parameters */
-        ssSetErrorStatus(S, "1-parameter requited: Ts");
+    /* Older models pass only Ts or Ts and Registers Base */
+    ssSetNumSFcnParams(S, -1);
+    if ((ssGetSFcnParamsCount(S) < PRM_COUNT_MIN) ||
+        (ssGetSFcnParamsCount(S) > PRM_COUNT)) {
+        ssSetErrorStatus(S, "1 to 3 parameters requited: Ts, Registers Base and Sample Actuate");
         return;
     }
 
@@ -230,10 +266,6 @@ static void mdlInitializeConditions(SimStruct *S)
   #ifndef WITHOUT_HW
     z3pmdrv1_state_t *z3pmcst = (z3pmdrv1_state_t *)PWORK_Z3PMDRV1_STATE(S);
 
-    z3pmcst->curadc_offs[0] = 0; /*2072*/
-    z3pmcst->curadc_offs[1] = 0; /*2077*/
-    z3pmcst->curadc_offs[2] = 0; /*2051*/
-
     z3pmcst->pos_offset = -z3pmcst->act_pos;
 
   #endif /*WITHOUT_HW*/
@@ -262,9 +294,16 @@ static void mdlStart(SimStruct *S)
         ssSetErrorStatus(S, "malloc z3pmcst failed");
         return;
     }
-    memset(z3pmcst, sizeof(*z3pmcst), 0);
+    memset(z3pmcst, 0, sizeof(*z3pmcst));
+
+    z3pmcst->regs_base_phys = (uintptr_t)PRM_REGS_BASE(S);
+    z3pmcst->uio_dev = z3pmdrv1_uio_dev;
 
-    z3pmcst->regs_base_phys = 0;
+    if ((z3pmcst->uio_dev != NULL) && (z3pmcst->regs_base_phys != 0)) {
+        ssSetErrorStatus(S, "Registers Base has to be 0 when built for UIO device");
+        free(z3pmcst);
+        return;
+    }
 
     if (z3pmdrv1_init(z3pmcst) < 0) {
         ssSetErrorStatus(S, "z3pmdrv1_init z3pmcst failed");
@@ -275,6 +314,18 @@ static void mdlStart(SimStruct *S)
 
     z3pmdrv1_transfer(z3pmcst);
 
+    {
+        real_T ts = ssGetSampleTime(S, 0);
+        unsigned int period_usec = ts > 0? (unsigned int)(ts * 1e6): 1000;
+
+        /* Typical offsets are around 2072, 2077 and 2051 */
+        if (z3pmdrv1_curadc_calibrate(z3pmcst, CURADC_CALIB_PERIODS,
+                                      period_usec) < 0) {
+            ssWarning(S, "z3pmdrv1_curadc_calibrate failed, zero offsets used");
+            memset(z3pmcst->curadc_offs, 0, sizeof(z3pmcst->curadc_offs));
+        }
+    }
+
   #endif /*WITHOUT_HW*/
 
     mdlInitializeConditions(S);
@@ -311,34 +362,40 @@ static void mdlOutputs(SimStruct *S, int_T tid)
 
   #ifndef WITHOUT_HW
     z3pmdrv1_state_t *z3pmcst = (z3pmdrv1_state_t *)PWORK_Z3PMDRV1_STATE(S);
-    uint32_t curadc_sqn_diff;
-    uint32_t curadc_val_diff;
     int i;
-    int diff_to_last_fl = 1;
+
+    if (PRM_SAMPLE_ACTUATE(S)) {
+        z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
+
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+            z3pmcst->curadc_cumsum_last[i] = z3pmcst->curadc_cumsum[i];
+
+        if (z3pmcst->irq_fd >= 0)
+            z3pmdrv1_wait_period(z3pmcst, PERIOD_WAIT_USEC);
+
+        z3pmdrv1_snapshot(z3pmcst);
+    }
    #if 0
+    uint32_t curadc_sqn_diff;
+    int diff_to_last_fl = 1;
     static unsigned long sqn_accum;
     static unsigned long sqn_accum_over;
     static unsigned long runs;
     static unsigned long runs_over;
     static unsigned long runs_miss;
     static unsigned int hist[512];
-   #endif
+
     curadc_sqn_diff = z3pmcst->curadc_sqn;
     if (diff_to_last_fl) {
       curadc_sqn_diff -= z3pmcst->curadc_sqn_last;
       curadc_sqn_diff &= 0xfff;
     }
+   #endif
 
-    if ((curadc_sqn_diff > 1) && (curadc_sqn_diff <= 450)) {
-        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
-            curadc_val_diff = z3pmcst->curadc_cumsum[i];
-            if (diff_to_last_fl) {
-              curadc_val_diff -= z3pmcst->curadc_cumsum_last[i];
-              curadc_val_diff &= 0xffffff;
-            }
-            cur_adc[i] = (real_T)curadc_val_diff / curadc_sqn_diff -
-                            z3pmcst->curadc_offs[i];
-        }
+    if (z3pmdrv1_curadc_currents(z3pmcst) >= 0) {
+        for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+            cur_adc[i] = z3pmcst->curadc_val[i] *
+                         (1.0 / (1 << Z3PMDRV1_CURADC_FRACT));
        #if 0
         runs++;
         sqn_accum += curadc_sqn_diff;
@@ -408,11 +465,6 @@ static void mdlUpdate(SimStruct *S, int_T tid)
     int i;
     real_T pwm;
 
-    z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
-
-    for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
-        z3pmcst->curadc_cumsum_last[i] = z3pmcst->curadc_cumsum[i];
-
     for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
         if (*pwm_en[i]) {
             pwm = *pwm_val[i] * 5000;
@@ -426,6 +478,19 @@ static void mdlUpdate(SimStruct *S, int_T tid)
         }
     }
 
+    if (PRM_SAMPLE_ACTUATE(S)) {
+        z3pmdrv1_pwm_write(z3pmcst);
+        return;
+    }
+
+    z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
+
+    for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+        z3pmcst->curadc_cumsum_last[i] = z3pmcst->curadc_cumsum[i];
+
+    if (z3pmcst->irq_fd >= 0)
+        z3pmdrv1_wait_period(z3pmcst, PERIOD_WAIT_USEC);
+
     z3pmdrv1_transfer(z3pmcst);
 
   #endif /*WITHOUT_HW*/
@@ -461,6 +526,7 @@ static void mdlTerminate(SimStruct *S)
 
     if (z3pmcst != NULL) {
         PWORK_Z3PMDRV1_STATE(S) = NULL;
+        z3pmdrv1_done(z3pmcst);
         free(z3pmcst);
     }
   #endif /*WITHOUT_HW*/
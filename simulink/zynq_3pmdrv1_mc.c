@@ -11,50 +11,34 @@
 */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 
 #include "zynq_3pmdrv1_mc.h"
+#include "zynq_3pmdrv1_regs.h"
 
-#define Z3PMDRV1_REG_BASE_PHYS     0x43c20000
-#define Z3PMDRV1_REG_SIZE          0x00001000
-
-#define Z3PMDRV1_REG_IRC_POS_o         0x0008
-#define Z3PMDRV1_REG_IRC_IDX_POS_o     0x000C
-
-#define Z3PMDRV1_REG_PWM1_o            0x0010
-#define Z3PMDRV1_REG_PWM2_o            0x0014
-#define Z3PMDRV1_REG_PWM3_o            0x0018
-
-#define Z3PMDRV1_REG_PWMX_VAL_m    0x00003fff
-#define Z3PMDRV1_REG_PWMX_EN_m     0x40000000
-#define Z3PMDRV1_REG_PWMX_SHDN_m   0x80000000
-
-#define Z3PMDRV1_REG_ADC_SQN_STAT_o    0x0020
-
-#define Z3PMDRV1_REG_ADSQST_SQN_m  0x00000fff
-#define Z3PMDRV1_REG_ADSQST_HAL1_m 0x00010000
-#define Z3PMDRV1_REG_ADSQST_HAL2_m 0x00020000
-#define Z3PMDRV1_REG_ADSQST_HAL3_m 0x00040000
-#define Z3PMDRV1_REG_ADSQST_ST1_m  0x00100000
-#define Z3PMDRV1_REG_ADSQST_ST2_m  0x00200000
-#define Z3PMDRV1_REG_ADSQST_ST3_m  0x00400000
-#define Z3PMDRV1_REG_ADSQST_PWST_m 0x01000000
-
-#define Z3PMDRV1_REG_ADC1_o            0x0024
-#define Z3PMDRV1_REG_ADC2_o            0x0028
-#define Z3PMDRV1_REG_ADC3_o            0x002C
+/* Snapshot reads when ADC sample arrives during the previous ones */
+#define Z3PMDRV1_SNAPSHOT_TRIES    3
 
 char *memdev="/dev/mem";
 
+/*
+ * Reciprocals of ADC sample counts, 2^32 / sqn rounded up,
+ * replace division when averaging accumulated currents.
+ */
+static uint32_t z3pmdrv1_curadc_recip[Z3PMDRV1_CURADC_SQN_MAX + 1];
+
 static inline
 uint32_t z3pmdrv1_reg_rd(z3pmdrv1_state_t *z3pmcst, unsigned reg_offs)
 {
@@ -67,72 +51,199 @@ void z3pmdrv1_reg_wr(z3pmdrv1_state_t *z3pmcst, unsigned reg_offs, uint32_t val)
 	*(volatile uint32_t*)((char*)z3pmcst->regs_base_virt + reg_offs) = val;
 }
 
-int z3pmdrv1_transfer(z3pmdrv1_state_t *z3pmcst)
+/* The overlay has to match register offsets */
+typedef char z3pmdrv1_regs_check_t[
+	(offsetof(z3pmdrv1_regs_t, pos.irc_pos) == Z3PMDRV1_REG_IRC_POS_o) &&
+	(offsetof(z3pmdrv1_regs_t, pwm[0]) == Z3PMDRV1_REG_PWM1_o) &&
+	(offsetof(z3pmdrv1_regs_t, adc.sqn_stat) == Z3PMDRV1_REG_ADC_SQN_STAT_o) &&
+	(offsetof(z3pmdrv1_regs_t, adc.sum[2]) == Z3PMDRV1_REG_ADC3_o)? 1: -1];
+
+void z3pmdrv1_pwm_write(z3pmdrv1_state_t *z3pmcst)
 {
+	volatile z3pmdrv1_regs_t *regs = z3pmcst->regs_base_virt;
+	uint32_t pwm_reg[Z3PMDRV1_CHAN_COUNT];
+	uint32_t pwm;
+	int i;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+		pwm = z3pmcst->pwm[i] & Z3PMDRV1_PWM_VALUE_m;
+		if (pwm > Z3PMDRV1_REG_PWMX_VAL_m)
+			pwm = Z3PMDRV1_REG_PWMX_VAL_m;
+		if (z3pmcst->pwm[i] & Z3PMDRV1_PWM_ENABLE)
+			pwm |= Z3PMDRV1_REG_PWMX_EN_m;
+		if (z3pmcst->pwm[i] & Z3PMDRV1_PWM_SHUTDOWN)
+			pwm |= Z3PMDRV1_REG_PWMX_SHDN_m;
+		pwm_reg[i] = pwm;
+	}
+
+	/* Stored back to back after all values are computed */
+	regs->pwm[0] = pwm_reg[0];
+	regs->pwm[1] = pwm_reg[1];
+	regs->pwm[2] = pwm_reg[2];
+}
+
+/*
+ * Position and ADC groups are read back to back by 32-bit
+ * volatile accesses, AXI-lite registers cannot be accessed
+ * by bytes or merged wider loads. ADC sequence number read
+ * after the group has to match the first one, otherwise
+ * a new sample has been accumulated in between and the
+ * snapshot is repeated.
+ */
+int z3pmdrv1_snapshot(z3pmdrv1_state_t *z3pmcst)
+{
+	volatile z3pmdrv1_regs_t *regs = z3pmcst->regs_base_virt;
+	z3pmdrv1_regs_pos_t pos;
+	z3pmdrv1_regs_adc_t adc;
 	uint32_t sqn_stat;
-	uint32_t pwm1, pwm2, pwm3;
-	uint32_t pwm1_fl = 0;
-	uint32_t pwm2_fl = 0;
-	uint32_t pwm3_fl = 0;
 	uint32_t idx;
-
-	pwm1 = z3pmcst->pwm[0];
-	pwm2 = z3pmcst->pwm[1];
-	pwm3 = z3pmcst->pwm[2];
-
-	if (pwm1 & Z3PMDRV1_PWM_ENABLE)
-	  pwm1_fl |= Z3PMDRV1_REG_PWMX_EN_m;
-	if (pwm1 & Z3PMDRV1_PWM_SHUTDOWN)
-	  pwm1_fl |= Z3PMDRV1_REG_PWMX_SHDN_m;
-	if (pwm2 & Z3PMDRV1_PWM_ENABLE)
-	  pwm2_fl |= Z3PMDRV1_REG_PWMX_EN_m;
-	if (pwm2 & Z3PMDRV1_PWM_SHUTDOWN)
-	  pwm2_fl |= Z3PMDRV1_REG_PWMX_SHDN_m;
-	if (pwm3 & Z3PMDRV1_PWM_ENABLE)
-	  pwm3_fl |= Z3PMDRV1_REG_PWMX_EN_m;
-	if (pwm3 & Z3PMDRV1_PWM_SHUTDOWN)
-	  pwm3_fl |= Z3PMDRV1_REG_PWMX_SHDN_m;
-
-	pwm1 &= Z3PMDRV1_PWM_VALUE_m;
-	pwm2 &= Z3PMDRV1_PWM_VALUE_m;
-	pwm3 &= Z3PMDRV1_PWM_VALUE_m;
-
-	if (pwm1 > Z3PMDRV1_REG_PWMX_VAL_m)
-		pwm1 = Z3PMDRV1_REG_PWMX_VAL_m;
-	if (pwm2 > Z3PMDRV1_REG_PWMX_VAL_m)
-		pwm2 = Z3PMDRV1_REG_PWMX_VAL_m;
-	if (pwm3 > Z3PMDRV1_REG_PWMX_VAL_m)
-		pwm3 = Z3PMDRV1_REG_PWMX_VAL_m;
-
-	z3pmdrv1_reg_wr(z3pmcst, Z3PMDRV1_REG_PWM1_o, pwm1 | pwm1_fl);
-	z3pmdrv1_reg_wr(z3pmcst, Z3PMDRV1_REG_PWM2_o, pwm2 | pwm2_fl);
-	z3pmdrv1_reg_wr(z3pmcst, Z3PMDRV1_REG_PWM3_o, pwm3 | pwm3_fl);
-
-	z3pmcst->act_pos = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_IRC_POS_o);
-	idx = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_IRC_IDX_POS_o);
+	int tries = Z3PMDRV1_SNAPSHOT_TRIES;
+
+	do {
+		pos.irc_pos = regs->pos.irc_pos;
+		pos.irc_idx_pos = regs->pos.irc_idx_pos;
+		adc.sqn_stat = regs->adc.sqn_stat;
+		adc.sum[0] = regs->adc.sum[0];
+		adc.sum[1] = regs->adc.sum[1];
+		adc.sum[2] = regs->adc.sum[2];
+		sqn_stat = regs->adc.sqn_stat;
+		if (!((sqn_stat ^ adc.sqn_stat) & Z3PMDRV1_REG_ADSQST_SQN_m))
+			break;
+		z3pmcst->snapshot_retries++;
+	} while (--tries > 0);
+
+	if (!tries)
+		return -1;
+
+	z3pmcst->act_pos = pos.irc_pos;
+	idx = pos.irc_idx_pos;
 
 	if (idx ^ z3pmcst->index_pos) {
 		z3pmcst->index_occur += 1;
 	}
 	z3pmcst->index_pos = idx;
 
-	sqn_stat = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC_SQN_STAT_o);
-	z3pmcst->curadc_sqn = sqn_stat & Z3PMDRV1_REG_ADSQST_SQN_m;
+	z3pmcst->curadc_sqn = adc.sqn_stat & Z3PMDRV1_REG_ADSQST_SQN_m;
+	z3pmcst->curadc_cumsum[0] = adc.sum[0];
+	z3pmcst->curadc_cumsum[1] = adc.sum[1];
+	z3pmcst->curadc_cumsum[2] = adc.sum[2];
 
-	z3pmcst->curadc_cumsum[0] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC1_o);
+	z3pmcst->hal_sensors =
+		((adc.sqn_stat & Z3PMDRV1_REG_ADSQST_HAL1_m)?1:0) |
+		((adc.sqn_stat & Z3PMDRV1_REG_ADSQST_HAL2_m)?2:0) |
+		((adc.sqn_stat & Z3PMDRV1_REG_ADSQST_HAL3_m)?4:0);
 
-	z3pmcst->curadc_cumsum[1] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC2_o);
+	return 0;
+}
 
-	z3pmcst->curadc_cumsum[2] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC3_o);
+int z3pmdrv1_transfer(z3pmdrv1_state_t *z3pmcst)
+{
+	z3pmdrv1_pwm_write(z3pmcst);
 
-	z3pmcst->hal_sensors =
-		((sqn_stat & Z3PMDRV1_REG_ADSQST_HAL1_m)?1:0) |
-		((sqn_stat & Z3PMDRV1_REG_ADSQST_HAL2_m)?2:0) |
-		((sqn_stat & Z3PMDRV1_REG_ADSQST_HAL3_m)?4:0);
+	return z3pmdrv1_snapshot(z3pmcst);
+}
+
+/*
+ * PWM registers of all axes are written first, posted writes
+ * proceed while snapshots are read.
+ */
+int z3pmdrv1_transfer_batch(z3pmdrv1_state_t *const *z3pmcst, int count)
+{
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < count; i++)
+		z3pmdrv1_pwm_write(z3pmcst[i]);
+
+	for (i = 0; i < count; i++)
+		if (z3pmdrv1_snapshot(z3pmcst[i]) < 0)
+			ret = -1;
+
+	return ret;
+}
+
+/*
+ * Compute average phase currents since the previous period
+ * (curadc_sqn_last and curadc_cumsum_last) into curadc_val[]
+ * with Z3PMDRV1_CURADC_FRACT fractional bits and offsets
+ * subtracted. Returns -1 and keeps previous values when
+ * sample count is out of the valid range.
+ */
+int z3pmdrv1_curadc_currents(z3pmdrv1_state_t *z3pmcst)
+{
+	uint32_t sqn_diff;
+	uint32_t val_diff;
+	uint32_t recip;
+	int i;
+
+	sqn_diff = (z3pmcst->curadc_sqn - z3pmcst->curadc_sqn_last) &
+		   Z3PMDRV1_CURADC_SQN_m;
+	if ((sqn_diff <= 1) || (sqn_diff > Z3PMDRV1_CURADC_SQN_MAX))
+		return -1;
+
+	recip = z3pmdrv1_curadc_recip[sqn_diff];
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++) {
+		val_diff = (z3pmcst->curadc_cumsum[i] -
+			    z3pmcst->curadc_cumsum_last[i]) &
+			   Z3PMDRV1_CURADC_SUM_m;
+		z3pmcst->curadc_val[i] =
+			(int32_t)(((uint64_t)val_diff * recip) >>
+				  (32 - Z3PMDRV1_CURADC_FRACT)) -
+			(z3pmcst->curadc_offs[i] << Z3PMDRV1_CURADC_FRACT);
+	}
 
 	return 0;
 }
 
+/*
+ * Average ADC readings over given number of periods with all
+ * PWM outputs shut down and store them as current offsets.
+ */
+int z3pmdrv1_curadc_calibrate(z3pmdrv1_state_t *z3pmcst, int periods,
+			      unsigned int period_usec)
+{
+	uint64_t val_sum[Z3PMDRV1_CHAN_COUNT] = {0, 0, 0};
+	uint32_t sqn_sum = 0;
+	uint32_t sqn_diff;
+	int i;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		z3pmcst->pwm[i] = Z3PMDRV1_PWM_SHUTDOWN;
+
+	if (z3pmdrv1_transfer(z3pmcst) < 0)
+		return -1;
+
+	while (periods-- > 0) {
+		z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+			z3pmcst->curadc_cumsum_last[i] = z3pmcst->curadc_cumsum[i];
+		usleep(period_usec);
+		if (z3pmdrv1_transfer(z3pmcst) < 0)
+			return -1;
+		sqn_diff = (z3pmcst->curadc_sqn - z3pmcst->curadc_sqn_last) &
+			   Z3PMDRV1_CURADC_SQN_m;
+		if ((sqn_diff <= 1) || (sqn_diff > Z3PMDRV1_CURADC_SQN_MAX))
+			continue;
+		for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+			val_sum[i] += (z3pmcst->curadc_cumsum[i] -
+				       z3pmcst->curadc_cumsum_last[i]) &
+				      Z3PMDRV1_CURADC_SUM_m;
+		sqn_sum += sqn_diff;
+	}
+
+	z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		z3pmcst->curadc_cumsum_last[i] = z3pmcst->curadc_cumsum[i];
+
+	if (!sqn_sum)
+		return -1;
+
+	for (i = 0; i < Z3PMDRV1_CHAN_COUNT; i++)
+		z3pmcst->curadc_offs[i] = (val_sum[i] + sqn_sum / 2) / sqn_sum;
+
+	return 0;
+}
 
 /*
  * The support function which returns pointer to the virtual
@@ -140,7 +251,8 @@ int z3pmdrv1_transfer(z3pmdrv1_state_t *z3pmcst)
  * process virtual memory space.
  */
 static inline
-void *map_phys_address(off_t region_base, size_t region_size, int opt_cached)
+void *map_phys_address(z3pmdrv1_state_t *z3pmcst, off_t region_base,
+		       size_t region_size, int opt_cached)
 {
 	unsigned long mem_window_size;
 	unsigned long pagesize;
@@ -183,9 +295,15 @@ void *map_phys_address(off_t region_base, size_t region_size, int opt_cached)
 
 	/* Report failure if the mmap is not allowed for given file or its region */
 	if (mm == MAP_FAILED) {
+		close(fd);
 		return NULL;
 	}
 
+	/* Kept for z3pmdrv1_done() */
+	z3pmcst->regs_fd = fd;
+	z3pmcst->regs_map = mm;
+	z3pmcst->regs_map_size = mem_window_size;
+
 	/*
 	 * Add offset in the page to the returned pointer for non-page-aligned
 	 * requests.
@@ -195,26 +313,19 @@ void *map_phys_address(off_t region_base, size_t region_size, int opt_cached)
 	return mem;
 }
 
-int z3pmdrv1_init(z3pmdrv1_state_t *z3pmcst)
+/* Read initial state of counters */
+static int z3pmdrv1_setup(z3pmdrv1_state_t *z3pmcst)
 {
-	int ret = 0;
 	uint32_t sqn_stat;
+	uint32_t sqn;
 
-	if (z3pmcst->regs_base_phys == 0) {
-		z3pmcst->regs_base_phys = Z3PMDRV1_REG_BASE_PHYS;
-	}
-
-	z3pmcst->regs_base_virt = map_phys_address(z3pmcst->regs_base_phys,
-					Z3PMDRV1_REG_SIZE, 0);
-
-	if (z3pmcst->regs_base_virt == NULL) {
-		ret = -1;
-		return ret;
-	}
+	for (sqn = 2; sqn <= Z3PMDRV1_CURADC_SQN_MAX; sqn++)
+		z3pmdrv1_curadc_recip[sqn] = 0xffffffff / sqn + 1;
 
 	sqn_stat = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC_SQN_STAT_o);
 	z3pmcst->curadc_sqn = sqn_stat & Z3PMDRV1_REG_ADSQST_SQN_m;
 	z3pmcst->curadc_sqn_last = z3pmcst->curadc_sqn;
+	z3pmcst->wait_sqn = z3pmcst->curadc_sqn;
 
 	z3pmcst->curadc_cumsum[0] = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC1_o);
 
@@ -224,5 +335,155 @@ int z3pmdrv1_init(z3pmdrv1_state_t *z3pmcst)
 
 	z3pmcst->index_pos = z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_IRC_IDX_POS_o);
 
-	return ret;
+	return 0;
+}
+
+int z3pmdrv1_attach(z3pmdrv1_state_t *z3pmcst, int regs_fd, int irq_fd)
+{
+	void *mm;
+
+	z3pmcst->regs_fd = regs_fd;
+	z3pmcst->irq_fd = irq_fd;
+
+	mm = mmap(NULL, Z3PMDRV1_REG_SIZE, PROT_WRITE|PROT_READ,
+		  MAP_SHARED, regs_fd, 0);
+	if (mm == MAP_FAILED) {
+		fprintf(stderr, "cannot map 3pmdrv1 registers\n");
+		return -1;
+	}
+	z3pmcst->regs_map = mm;
+	z3pmcst->regs_map_size = Z3PMDRV1_REG_SIZE;
+	z3pmcst->regs_base_virt = mm;
+
+	return z3pmdrv1_setup(z3pmcst);
+}
+
+int z3pmdrv1_init(z3pmdrv1_state_t *z3pmcst)
+{
+	int fd;
+
+	z3pmcst->regs_fd = -1;
+	z3pmcst->irq_fd = -1;
+
+	/* UIO device provides both register window and interrupt */
+	if (z3pmcst->uio_dev != NULL) {
+		if (z3pmcst->regs_base_phys != 0) {
+			fprintf(stderr, "registers base cannot be selected for UIO device %s\n",
+				z3pmcst->uio_dev);
+			return -1;
+		}
+		fd = open(z3pmcst->uio_dev, O_RDWR);
+		if (fd < 0) {
+			fprintf(stderr, "cannot open %s\n", z3pmcst->uio_dev);
+			return -1;
+		}
+		z3pmcst->irq_eventfd_fl = 0;
+		return z3pmdrv1_attach(z3pmcst, fd, fd);
+	}
+
+	if (z3pmcst->regs_base_phys == 0) {
+		z3pmcst->regs_base_phys = Z3PMDRV1_REG_BASE_PHYS;
+	}
+
+	z3pmcst->regs_base_virt = map_phys_address(z3pmcst, z3pmcst->regs_base_phys,
+					Z3PMDRV1_REG_SIZE, 0);
+
+	if (z3pmcst->regs_base_virt == NULL)
+		return -1;
+
+	return z3pmdrv1_setup(z3pmcst);
+}
+
+void z3pmdrv1_done(z3pmdrv1_state_t *z3pmcst)
+{
+	if (z3pmcst->regs_map != NULL)
+		munmap(z3pmcst->regs_map, z3pmcst->regs_map_size);
+	z3pmcst->regs_map = NULL;
+	z3pmcst->regs_base_virt = NULL;
+
+	if ((z3pmcst->irq_fd >= 0) && (z3pmcst->irq_fd != z3pmcst->regs_fd))
+		close(z3pmcst->irq_fd);
+	if (z3pmcst->regs_fd >= 0)
+		close(z3pmcst->regs_fd);
+	z3pmcst->irq_fd = -1;
+	z3pmcst->regs_fd = -1;
+}
+
+/*
+ * UIO read returns 32-bit count of all interrupts, eventfd
+ * returns 64-bit count since the previous read. UIO interrupt
+ * is (re)enabled by write of 1 before waiting.
+ */
+static int z3pmdrv1_wait_irq(z3pmdrv1_state_t *z3pmcst, unsigned int timeout_usec)
+{
+	struct pollfd pfd;
+	uint32_t uio_count;
+	uint64_t ev_count;
+	uint32_t missed;
+	int32_t irq_on = 1;
+	int ret;
+
+	if (!z3pmcst->irq_eventfd_fl)
+		write(z3pmcst->irq_fd, &irq_on, sizeof(irq_on));
+
+	pfd.fd = z3pmcst->irq_fd;
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, (timeout_usec + 999) / 1000);
+	if (ret <= 0)
+		return -1;
+
+	if (z3pmcst->irq_eventfd_fl) {
+		if (read(z3pmcst->irq_fd, &ev_count, sizeof(ev_count)) != sizeof(ev_count))
+			return -1;
+		missed = ev_count - 1;
+		z3pmcst->irq_count += ev_count;
+	} else {
+		if (read(z3pmcst->irq_fd, &uio_count, sizeof(uio_count)) != sizeof(uio_count))
+			return -1;
+		missed = z3pmcst->irq_count? uio_count - z3pmcst->irq_count - 1: 0;
+		z3pmcst->irq_count = uio_count;
+	}
+	z3pmcst->periods_missed += missed;
+
+	return 0;
+}
+
+/*
+ * Without interrupt the period start is found by busy polling
+ * of ADC sequence number, period boundary is kept on multiples
+ * of wait_sqn_step samples from the first wait.
+ */
+static int z3pmdrv1_wait_sqn(z3pmdrv1_state_t *z3pmcst, unsigned int timeout_usec)
+{
+	uint32_t step = z3pmcst->wait_sqn_step? z3pmcst->wait_sqn_step: 1;
+	uint32_t sqn_diff;
+	struct timespec t0, t;
+	int64_t nsec;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do {
+		sqn_diff = (z3pmdrv1_reg_rd(z3pmcst, Z3PMDRV1_REG_ADC_SQN_STAT_o) -
+			    z3pmcst->wait_sqn) & Z3PMDRV1_REG_ADSQST_SQN_m;
+		if (sqn_diff >= step)
+			break;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		nsec = (int64_t)(t.tv_sec - t0.tv_sec) * 1000000000 +
+		       (t.tv_nsec - t0.tv_nsec);
+	} while (nsec < (int64_t)timeout_usec * 1000);
+
+	if (sqn_diff < step)
+		return -1;
+
+	z3pmcst->wait_sqn += sqn_diff - sqn_diff % step;
+	z3pmcst->periods_missed += sqn_diff / step - 1;
+
+	return 0;
+}
+
+int z3pmdrv1_wait_period(z3pmdrv1_state_t *z3pmcst, unsigned int timeout_usec)
+{
+	if (z3pmcst->irq_fd >= 0)
+		return z3pmdrv1_wait_irq(z3pmcst, timeout_usec);
+	else
+		return z3pmdrv1_wait_sqn(z3pmcst, timeout_usec);
 }
@@ -2,6 +2,7 @@
 #define _ZYNQ_3PMDRV1_MC_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define Z3PMDRV1_CHAN_COUNT    3
 
@@ -9,9 +10,27 @@
 #define Z3PMDRV1_PWM_ENABLE    0x10000
 #define Z3PMDRV1_PWM_SHUTDOWN  0x20000
 
+#define Z3PMDRV1_CURADC_SQN_m    0xfff
+#define Z3PMDRV1_CURADC_SUM_m    0xffffff
+/* Longest accumulation period which does not overflow 24-bit sums */
+#define Z3PMDRV1_CURADC_SQN_MAX  450
+/* Fractional bits of currents returned by z3pmdrv1_curadc_currents */
+#define Z3PMDRV1_CURADC_FRACT    8
+
 typedef struct z3pmdrv1_state_t {
   uintptr_t regs_base_phys;
   void     *regs_base_virt;
+  char     *uio_dev;         /* UIO device, /dev/mem is mapped when NULL */
+  int      regs_fd;
+  int      irq_fd;           /* -1 when period is found by polling */
+  int      irq_eventfd_fl;   /* irq_fd is eventfd of mock device */
+  void     *regs_map;
+  size_t   regs_map_size;
+  uint32_t irq_count;
+  uint32_t periods_missed;
+  uint16_t wait_sqn;         /* ADC sequence number at period start */
+  uint16_t wait_sqn_step;    /* ADC samples per period for polling */
+  uint32_t snapshot_retries;
   uint32_t pwm[Z3PMDRV1_CHAN_COUNT];
   uint32_t act_pos;
   uint32_t index_pos;
@@ -28,6 +47,42 @@ typedef struct z3pmdrv1_state_t {
 
 int z3pmdrv1_init(z3pmdrv1_state_t *z3pmcst);
 
+/*
+ * Use already open register window (mapped at offset 0) and
+ * interrupt source, descriptors are closed by z3pmdrv1_done()
+ */
+int z3pmdrv1_attach(z3pmdrv1_state_t *z3pmcst, int regs_fd, int irq_fd);
+
+void z3pmdrv1_done(z3pmdrv1_state_t *z3pmcst);
+
+/*
+ * Block until the next PWM period starts. The interrupt is used
+ * when available, ADC sequence number is polled otherwise.
+ * Returns -1 on timeout or error.
+ */
+int z3pmdrv1_wait_period(z3pmdrv1_state_t *z3pmcst, unsigned int timeout_usec);
+
+/* Write PWM registers only */
+void z3pmdrv1_pwm_write(z3pmdrv1_state_t *z3pmcst);
+
+/*
+ * Read consistent snapshot of position, index and ADC state,
+ * returns -1 when ADC does not settle
+ */
+int z3pmdrv1_snapshot(z3pmdrv1_state_t *z3pmcst);
+
+/*
+ * Write PWM and read consistent snapshot of position, index
+ * and ADC state, returns -1 when ADC does not settle
+ */
 int z3pmdrv1_transfer(z3pmdrv1_state_t *z3pmcst);
 
+/* Transfer for several IP cores (axes) at different bases */
+int z3pmdrv1_transfer_batch(z3pmdrv1_state_t *const *z3pmcst, int count);
+
+int z3pmdrv1_curadc_currents(z3pmdrv1_state_t *z3pmcst);
+
+int z3pmdrv1_curadc_calibrate(z3pmdrv1_state_t *z3pmcst, int periods,
+			      unsigned int period_usec);
+
 #endif /*_ZYNQ_3PMDRV1_MC_H*/
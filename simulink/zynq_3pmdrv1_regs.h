@@ -0,0 +1,68 @@
+/*
+  Register map of Zynq 3-phase motor driver IP core
+  (3pmdrv1) on MZ_APO board, shared by hardware access
+  code and its mock device. The map is taken over from
+  zynq_3pmdrv1_mc.c.
+
+  (C) 2017 by Pavel Pisa ppisa@pikron.com (zynq_3pmdrv1_mc.c)
+  (C) 2026 rpi-rt-control contributors
+*/
+
+#ifndef _ZYNQ_3PMDRV1_REGS_H
+#define _ZYNQ_3PMDRV1_REGS_H
+
+#include <stdint.h>
+
+#define Z3PMDRV1_REG_BASE_PHYS     0x43c20000
+#define Z3PMDRV1_REG_SIZE          0x00001000
+
+#define Z3PMDRV1_REG_IRC_POS_o         0x0008
+#define Z3PMDRV1_REG_IRC_IDX_POS_o     0x000C
+
+#define Z3PMDRV1_REG_PWM1_o            0x0010
+#define Z3PMDRV1_REG_PWM2_o            0x0014
+#define Z3PMDRV1_REG_PWM3_o            0x0018
+
+#define Z3PMDRV1_REG_PWMX_VAL_m    0x00003fff
+#define Z3PMDRV1_REG_PWMX_EN_m     0x40000000
+#define Z3PMDRV1_REG_PWMX_SHDN_m   0x80000000
+
+#define Z3PMDRV1_REG_ADC_SQN_STAT_o    0x0020
+
+#define Z3PMDRV1_REG_ADSQST_SQN_m  0x00000fff
+#define Z3PMDRV1_REG_ADSQST_HAL1_m 0x00010000
+#define Z3PMDRV1_REG_ADSQST_HAL2_m 0x00020000
+#define Z3PMDRV1_REG_ADSQST_HAL3_m 0x00040000
+#define Z3PMDRV1_REG_ADSQST_ST1_m  0x00100000
+#define Z3PMDRV1_REG_ADSQST_ST2_m  0x00200000
+#define Z3PMDRV1_REG_ADSQST_ST3_m  0x00400000
+#define Z3PMDRV1_REG_ADSQST_PWST_m 0x01000000
+
+#define Z3PMDRV1_REG_ADC1_o            0x0024
+#define Z3PMDRV1_REG_ADC2_o            0x0028
+#define Z3PMDRV1_REG_ADC3_o            0x002C
+
+/*
+ * Overlay of the register window. Registers which are read
+ * together are grouped, so that each group is copied by one
+ * multiple-word access.
+ */
+typedef struct z3pmdrv1_regs_pos_t {
+	uint32_t irc_pos;          /* 0x0008 */
+	uint32_t irc_idx_pos;      /* 0x000C */
+} z3pmdrv1_regs_pos_t;
+
+typedef struct z3pmdrv1_regs_adc_t {
+	uint32_t sqn_stat;         /* 0x0020 */
+	uint32_t sum[3];           /* 0x0024 */
+} z3pmdrv1_regs_adc_t;
+
+typedef struct z3pmdrv1_regs_t {
+	uint32_t reserved0[2];
+	z3pmdrv1_regs_pos_t pos;
+	uint32_t pwm[3];           /* 0x0010 */
+	uint32_t reserved1;
+	z3pmdrv1_regs_adc_t adc;
+} z3pmdrv1_regs_t;
+
+#endif /*_ZYNQ_3PMDRV1_REGS_H*/